@@ -16,9 +16,14 @@ Vector *new_vector();
 void vec_push(Vector *vec, const void *elem);
 void runtest_util();
 
+// Entries are kept in the order of insertion, and a later entry of a key
+// hides earlier ones. Keys are looked up through an open-addressing hash
+// index of the latest entries.
 typedef struct {
     Vector *keys;
     Vector *vals;
+    int *index;     // Entry index plus 1 for each slot, or 0 if empty.
+    int nslots;     // A power of 2.
 } Map;
 
 Map *new_map();
@@ -40,12 +45,16 @@ enum {
     TK_TYPE_SHORT,
     TK_TYPE_INT,
     TK_STRUCT,
+    TK_CONST,       // Type qualifier "const".
+    TK_ALIGNAS,     // Alignment specifier "_Alignas".
+    TK_ATTRIBUTE,   // "__attribute__".
     TK_SIZEOF,      // "sizeof" operator.
     TK_IDENT,       // Represents an identifier.
     TK_ASSIGNPLUS,  // "+=".
     TK_ASSIGNMINUS, // "-=".
     TK_ASSIGNMULT,  // "*=".
     TK_ASSIGNDIVIDE,// "/=".
+    TK_ASSIGNMOD,   // "%=".
     TK_ASSIGNOR,    // "|=".
     TK_ASSIGNXOR,   // "^=".
     TK_ASSIGNAND,   // "&=".
@@ -57,10 +66,16 @@ enum {
     TK_LOGICALAND,  // "&&".
     TK_INCREMENT,   // "++".
     TK_DECREMENT,   // "--".
+    TK_ELLIPSIS,    // "..." in a parameter list.
     TK_IF,
     TK_ELSE,
     TK_WHILE,
     TK_FOR,
+    TK_SWITCH,
+    TK_CASE,
+    TK_DEFAULT,
+    TK_BREAK,
+    TK_GOTO,
     TK_RETURN,
     TK_EOF,         // Represents end of input.
 };
@@ -99,9 +114,18 @@ enum {
     ND_NOTEQUAL,
     ND_LOGICAL,     // Logical "or" or "and" pair (E1 || E2 or E1 && E2).
     ND_MEMBER,      // Struct member access.
+    ND_COMMA,       // Comma operator (E1, E2). Only made by the optimizer.
+    ND_VLOOP,       // Vectorized loop. Only made by the optimizer.
     ND_IF,
     ND_WHILE,
     ND_FOR,
+    ND_SWITCH,
+    ND_CASE,        // Case label, directly in the body of a switch statement.
+    ND_DEFAULT,     // Default label, as well as a case label.
+    ND_BREAK,
+    ND_LABEL,       // Named label, whose assembly symbol is in name.
+    ND_LABELADDR,   // Address of a named label (&&L), as a symbol in name.
+    ND_GOTO,        // Goto statement to the address in rhs.
     ND_RETURN,
     ND_CALL,
     ND_COMPOUND,    // Compound statement.
@@ -115,6 +139,8 @@ struct Node;
 // =============================================================================
 typedef struct Type {
     enum { CHAR, SHORT, INT, PTR, ARRAY, STRUCT } ty;
+    bool is_const;
+    size_t align;   // Alignment given explicitly, or 0 for the natural one.
     struct Type *ptr_of;
     size_t array_len;
     Map *member_types;
@@ -122,7 +148,10 @@ typedef struct Type {
 } Type;
 
 size_t get_typesize(const Type *type);
+size_t get_typealign(const Type *type);
 bool is_basic_type(const Type *type);
+bool is_ptr_like(const Type *type);
+bool is_readonly(const Type *type);
 Type *deduce_type(int operator, struct Node *lhs, struct Node *rhs);
 void add_member(Type *struct_type, const char *member_name, Type *member_type);
 size_t get_member_offset(const Type *type, const char *member_name);
@@ -132,6 +161,7 @@ void runtest_type(void);
 typedef struct {
     Type *type;
     size_t offset;
+    const char *reg;    // Register holding a parameter, or NULL if on the stack.
 } Ident;
 
 typedef struct Node {
@@ -139,7 +169,7 @@ typedef struct Node {
     Type *type;         // For expressions, declarations, and identifiers.
 
     union {
-        // ND_NUM literal.
+        // ND_NUM literal, or the value of a case label.
         int val;
 
         // Struct or union member access.
@@ -171,13 +201,17 @@ typedef struct Node {
         struct {
             char *name;
             struct Node *declinit;  // For declaration initializers.
+            bool zeroinit;          // Zero the variable before any initializer.
+            Vector *inits;          // Init elements of a global initializer.
         };
 
         // Function declaration or call.
         struct {
             char *fname;
             Vector *fargs;
-            struct Node *fbody;
+            struct Node *fbody;     // NULL for a prototype.
+            bool variadic;          // For a call, also when not declared.
+            bool unspecified;       // Declared with "()", taking any arguments.
         };
 
         // Compound statement.
@@ -186,7 +220,7 @@ typedef struct Node {
             Map *localvars;         // Local variables in a compound statement.
         };
 
-        // Selection statement.
+        // Selection statement. The body of a switch statement is in then.
         struct {
             struct Node *cond;
             struct Node *then;
@@ -200,12 +234,29 @@ typedef struct Node {
             struct Node *iterbody;
             struct Node *step;
         };
+
+        // Vectorized loop. It runs vstmt for a vector of consecutive values
+        // of vindex at once while they are less than vlimit.
+        struct {
+            struct Node *vindex;
+            struct Node *vlimit;
+            struct Node *vstmt;
+        };
     };
 
 } Node;
 
+// An element of an initializer, stored to a part of a variable.
+typedef struct {
+    size_t offset;
+    Type *type;
+    Node *lval;     // The part of the variable.
+    Node *value;
+} Init;
+
 // A buffer to store parsed functions.
 extern Vector *funcdefs;
+extern Map *functions;
 extern Map *globalvars;
 extern Map *strings;
 
@@ -218,6 +269,7 @@ Node *new_node_ident(const Token *tok, Type *type);
 Node *new_node_string(const Token *tok);
 Node *new_node_declaration(const Node* declarator, Type *type, Node *init);
 Node *new_funcdef(const Token *tok);
+bool eval_const(const Node *node, char **sym, int *val);
 
 // Function to parse an expression to abstract syntax trees.
 void program(void);
@@ -231,6 +283,7 @@ Node *compound(void);
 Node *statement(void);
 Node *assign(void);
 Node *selection(void);
+Node *selection_switch(void);
 Node *iteration_while(void);
 Node *iteration_for(void);
 Node *logical_or(void);
@@ -247,7 +300,55 @@ Node *postfix(void);
 Node *term(void);
 
 
+// =============================================================================
+// Optimization on abstract syntax trees.
+// =============================================================================
+void optimize(Node *func);
+bool falls_through(const Node *stmt);
+bool frame_escapes(Node *func);
+bool has_call(const Node *node);
+bool has_goto(const Node *node);
+bool is_leaf_function(Node *func);
+void find_calls(Node *node, Vector *calls);
+void inline_functions(Vector *funcdefs);
+void opt_report(void);
+
+
 // =============================================================================
 // Assembly generation.
 // =============================================================================
+void gen_globals(const Map *vars);
 void gen_function(Node *func);
+
+
+// =============================================================================
+// Instruction list and peephole optimization.
+// =============================================================================
+// An assembly line. Functions are emitted to a list of these so that the
+// peephole optimizer can rewrite them before they are printed.
+typedef struct {
+    enum { IN_OP, IN_LABEL, IN_DIRECTIVE, IN_DELETED } kind;
+    const char *op;         // Mnemonic, label name, or directive name.
+    const char *args[3];    // Operands.
+    int nargs;
+} Insn;
+
+Insn *parse_insn(const char *line);
+void emit(const char *fmt, ...);
+void emit_flush(void);
+void emit_discard(void);
+bool emitted_clobbers(const char *reg);
+void peephole(Vector *insns);
+void peephole_report(void);
+void runtest_peephole(void);
+
+
+// =============================================================================
+// Compiler options.
+// =============================================================================
+extern bool opt_remarks;    // -Rpass: Report what optimizations did.
+extern int unroll_factor;   // -funroll-loops=N: Unroll loops by N. 0 chooses by size.
+extern bool use_avx2;       // -mavx2: Vectorize loops with AVX2 instructions.
+extern int inline_limit;    // -finline-limit=N: Inline functions of up to N nodes. 0 disables.
+extern int block_inline_limit;  // -fblock-inline-limit=N: Unroll block copies of up to N bytes.
+extern bool omit_frame_pointer;    // -fomit-frame-pointer: Address the frame relative to rsp.
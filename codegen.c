@@ -2,131 +2,416 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "cc.h"
 
 // Counter for generating labels.
 static int nlabel = 0;
 
 // =============================================================================
-// Count identifiers in an AST.
+// Argument passing.
+//
+// Arguments are classified per the SysV ABI. Each scalar and each 8 bytes of
+// a struct of up to 16 bytes take an argument register while enough are
+// left. Other arguments go to the stack argument area in order, each
+// rounded up to 8 bytes. A struct of up to 16 bytes is returned in rax and
+// rdx. A larger one is returned to memory given by the caller in a hidden
+// first argument.
 // =============================================================================
-static Type *make_type(int type_enum, Type *ptr_of) {
-    Type *t = calloc(1, sizeof(Type));
-    t->ty = type_enum;
-    t->ptr_of = ptr_of;
-    return t;
+// Registers holding the first 6 arguments.
+static const char *arg_regs[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+
+typedef struct {
+    int reg;        // Index of the first argument register, or -1.
+    int offset;     // Offset in the stack argument area.
+} ArgLoc;
+
+static bool is_memory_class(const Type *type) {
+    return type->ty == STRUCT && get_typesize(type) > 16;
+}
+
+// Classify arguments given as nodes of their types. Return the size of the
+// stack argument area.
+static int classify_args(const Vector *args, bool sret, ArgLoc *locs) {
+    int next = sret ? 1 : 0;
+    int offset = 0;
+    for (int i = 0; i < args->len; i++) {
+        const Type *type = ((Node *)args->data[i])->type;
+        int size = (int)get_typesize(type);
+        int nregs = type->ty != STRUCT ? 1 : is_memory_class(type) ? 0 : size / 8;
+        if (nregs > 0 && next + nregs <= 6) {
+            locs[i] = (ArgLoc) { .reg = next, .offset = -1 };
+            next += nregs;
+        } else {
+            locs[i] = (ArgLoc) { .reg = -1, .offset = offset };
+            offset += type->ty == STRUCT ? size : 8;
+        }
+    }
+    return offset;
 }
 
-static void put_ident(Map *idents, char *name, Type *type, int offset) {
-    Ident *ident = malloc(sizeof(Ident));
+// Return true if every parameter is a scalar in the register of its index.
+static bool has_simple_params(const Node *func) {
+    if (func->type->ty == STRUCT)
+        return false;
+    for (int i = 0; i < func->fargs->len; i++)
+        if (((Node *)func->fargs->data[i])->type->ty == STRUCT)
+            return false;
+    return true;
+}
+
+// =============================================================================
+// Stack frame layout.
+//
+// Every local variable, including those in nested blocks, gets a slot of its
+// size at its natural alignment. A variable lives from its declaration to the
+// end of its block. Variables interfere if their lifetimes overlap, and those
+// that do not, e.g., variables in sibling blocks, may share space. Slots are
+// colored greedily from the largest variable, each at the highest address not
+// taken by an interfering variable. The parser gives every local variable of
+// a function a distinct name, so that the slots are looked up by names.
+// =============================================================================
+typedef struct {
+    const char *name;
+    Type *type;
+    int start;      // Lifetime in the order of declarations and block ends.
+    int end;
+    int offset;     // From the frame base.
+} Slot;
+
+// Counter ordering declarations and block ends.
+static int npoints;
+
+static Ident *put_ident(Map *idents, char *name, Type *type, int offset) {
+    Ident *ident = calloc(1, sizeof(Ident));
     ident->type = type;
     ident->offset = offset;
     map_put(idents, name, (void *)(ident));
+    return ident;
 }
 
-static int decls_to_offsets(const Vector *code, Map *idents, int starting_offset) {
-#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
-    // Search for declarations and assign offsets.
-    int offset = starting_offset;
-    for (int i = 0; i < code->len; i++) {
-        Node *node = (Node *)code->data[i];
-        if (node->ty != ND_DECLARATION)
-            continue;
+static Slot *new_slot(const char *name, Type *type) {
+    Slot *slot = calloc(1, sizeof(Slot));
+    slot->name = name;
+    slot->type = type;
+    slot->start = npoints++;
+    return slot;
+}
 
-        switch (node->type->ty) {
-        case CHAR:
-        case SHORT:
-        case INT:
-        case PTR:
-            put_ident(idents, node->name, node->type, offset);
-            offset -= 8;
-            break;
-        case ARRAY:
-            offset -= get_typesize(node->type);
-            // Align to 8 bytes (assuming offset <= 0);
-            offset -= offset & 7;
-            put_ident(idents, node->name, node->type, offset + 8);
-            assert(offset % 8 == 0);
-            break;
-        case STRUCT:
-            offset -= get_typesize(node->type);
-            // Align to 8 bytes (assuming offset <= 0);
-            offset -= offset & 7;
-            put_ident(idents, node->name, node->type, offset + 8);
-            assert(offset %8 == 0);
-            break;
-        default:
-            fprintf(stderr, "Unknown type id %d.\n", node->type->ty);
-            exit(1);
+// Collect the variables declared in a statement and in blocks in it.
+static void find_slots(const Node *node, Vector *slots) {
+    switch (node->ty) {
+    case ND_COMPOUND:
+    {
+        Vector *block = new_vector();
+        for (int i = 0; i < node->stmts->len; i++) {
+            const Node *stmt = (Node *)node->stmts->data[i];
+            if (stmt->ty == ND_DECLARATION) {
+                Slot *slot = new_slot(stmt->name, stmt->type);
+                vec_push(block, slot);
+                vec_push(slots, slot);
+            } else {
+                find_slots(stmt, slots);
+            }
         }
+        int end = npoints++;
+        for (int i = 0; i < block->len; i++)
+            ((Slot *)block->data[i])->end = end;
+        return;
     }
-    return offset;
+    case ND_IF:
+    case ND_SWITCH:
+        find_slots(node->then, slots);
+        if (node->els)
+            find_slots(node->els, slots);
+        return;
+    case ND_WHILE:
+    case ND_FOR:
+        find_slots(node->iterbody, slots);
+        return;
+    default:
+        return;
+    }
+}
+
+static bool interferes(const Slot *a, const Slot *b) {
+    return a->start <= b->end && b->start <= a->end;
+}
+
+static int align_down(int offset, int align) {
+    return offset - ((offset % align) + align) % align;
 }
 
-// Count identifiers in a compound statement and assign offset.
-static int idents_in_func(const Node *func, Map *idents) {
-    int offset = -8;
-    // First 6 function parameters are to be copied to the stack.
+// The largest alignment of the stack slots of the current function. Slots
+// are aligned to at most 16 bytes, the alignment of the stack at calls.
+static int frame_align;
+
+// Calls returning structs and the names of the slots receiving the results.
+static Vector *ret_calls;
+static Vector *ret_names;
+
+// Assign offsets to parameters and local variables. Parameters in resident
+// are kept in the registers mapped to them. Return the size of the frame
+// below the frame base.
+static int layout_frame(const Node *func, const Map *resident, Map *idents) {
+    npoints = 0;
+    Vector *slots = new_vector();
+
+    // Parameters in registers are copied to the stack unless they stay in
+    // registers. So are the address of the memory for a returned struct and
+    // the structs returned by calls. They live throughout the function.
     int nargs = func->fargs->len;
-    int nregargs = nargs <= 6 ? nargs : 6;
-    int nstackargs = nargs - nregargs;
-    for (int i = 0; i < nregargs; i++) {
-        put_ident(
-            idents,
-            ((Node *)func->fargs->data[i])->name,
-            make_type(INT, NULL),
-            offset);
-        offset -= 8;
+    ArgLoc *locs = malloc(sizeof(ArgLoc) * (nargs + 1));
+    classify_args(func->fargs, is_memory_class(func->type), locs);
+    Vector *params = new_vector();
+    for (int i = 0; i < nargs; i++) {
+        Node *param = (Node *)func->fargs->data[i];
+        if (locs[i].reg < 0)
+            continue;
+        const char *reg = map_get(resident, param->name);
+        if (reg)
+            put_ident(idents, param->name, param->type, 0)->reg = reg;
+        else
+            vec_push(params, new_slot(param->name, param->type));
+    }
+    if (is_memory_class(func->type)) {
+        Type *ptr = calloc(1, sizeof(Type));
+        ptr->ty = PTR;
+        ptr->ptr_of = func->type;
+        vec_push(params, new_slot(".sret", ptr));
     }
+    Vector *calls = new_vector();
+    find_calls(func->fbody, calls);
+    ret_calls = new_vector();
+    ret_names = new_vector();
+    for (int i = 0; i < calls->len; i++) {
+        Node *call = (Node *)calls->data[i];
+        if (call->type->ty != STRUCT)
+            continue;
+        char *name = malloc(16);
+        sprintf(name, ".ret%d", ret_calls->len);
+        vec_push(ret_calls, call);
+        vec_push(ret_names, name);
+        vec_push(params, new_slot(name, call->type));
+    }
+    for (int i = 0; i < params->len; i++)
+        vec_push(slots, params->data[i]);
+    find_slots(func->fbody, slots);
+    for (int i = 0; i < params->len; i++)
+        ((Slot *)params->data[i])->end = npoints;
+
+    // A goto may enter a block with the variables of a block it left still
+    // in use, so no variables share space in a function with labels.
+    if (has_goto(func->fbody)) {
+        for (int i = 0; i < slots->len; i++) {
+            ((Slot *)slots->data[i])->start = 0;
+            ((Slot *)slots->data[i])->end = npoints;
+        }
+    }
+
     // The rest of args are in stack. Store positive offsets,
     // skipping pushed rbp and the return address.
-    for (int i = nstackargs - 1; i >= 0; i--) {
-        put_ident(
-            idents,
-            ((Node *)func->fargs->data[i+6])->name,
-            make_type(INT, NULL),
-            8 * (i + 2));
+    for (int i = 0; i < nargs; i++) {
+        Node *param = (Node *)func->fargs->data[i];
+        if (locs[i].reg < 0)
+            put_ident(idents, param->name, param->type, 16 + locs[i].offset);
+    }
+
+    // Place larger variables first. Insertion sort keeps the order of the
+    // declarations among those of the same size.
+    for (int i = 1; i < slots->len; i++) {
+        const void *slot = slots->data[i];
+        size_t size = get_typesize(((Slot *)slot)->type);
+        int j = i;
+        for (; j > 0 && get_typesize(((Slot *)slots->data[j-1])->type) < size; j--)
+            slots->data[j] = slots->data[j-1];
+        slots->data[j] = slot;
     }
-    // Count identifiers in the function body and assign offsets.
-    int offset_end = decls_to_offsets(func->fbody->stmts, idents, offset);
-    return offset_end + 8;
+
+    // Without a frame pointer, the frame base is the stack pointer at the
+    // entry, which is 8 bytes off from a 16-byte boundary.
+    int bias = omit_frame_pointer ? 8 : 0;
+    int frame_size = 0;
+    frame_align = 8;
+    for (int i = 0; i < slots->len; i++) {
+        Slot *slot = (Slot *)slots->data[i];
+        int size = (int)get_typesize(slot->type);
+        int align = (int)get_typealign(slot->type);
+        if (align > 16)
+            align = 16;
+        if (align > frame_align)
+            frame_align = align;
+        int offset = align_down(bias - size, align) - bias;
+        for (int j = 0; j < i; j++) {
+            Slot *other = (Slot *)slots->data[j];
+            int other_size = (int)get_typesize(other->type);
+            if (!interferes(slot, other) || offset >= other->offset + other_size
+                    || other->offset >= offset + size)
+                continue;
+            // Move below the other variable and check all placed ones again.
+            offset = align_down(bias + other->offset - size, align) - bias;
+            j = -1;
+        }
+        slot->offset = offset;
+        put_ident(idents, (char *)slot->name, slot->type, offset);
+        if (-offset > frame_size)
+            frame_size = -offset;
+    }
+    // Keep the stack pointer 8-byte aligned.
+    return (frame_size + 7) & ~7;
 }
 
-// Track stack position for adjusting alignment.
+// Track stack position for adjusting alignment and addressing the frame
+// relative to rsp. It counts the bytes below the return address.
 static int stackpos = 0;
+static int max_stackpos;
+
+// Distance of the local variables in the red zone below the frame base. The
+// space in between is used by the pushes in the function.
+static int red_zone_shift;
 
 // =============================================================================
 // Assembly generation from an AST.
 // =============================================================================
 static void push_imm32(int imm) {
-    printf("  push %d\n", imm);
+    emit("  push %d\n", imm);
     stackpos += 8;
+    if (stackpos > max_stackpos)
+        max_stackpos = stackpos;
 }
 
 static void push(const char *reg) {
-    printf("  push %s\n", reg);
+    emit("  push %s\n", reg);
     stackpos += 8;
+    if (stackpos > max_stackpos)
+        max_stackpos = stackpos;
 }
 
 static void pop(const char *reg) {
-    printf("  pop %s\n", reg);
+    emit("  pop %s\n", reg);
     stackpos -= 8;
     assert(stackpos >= 0);
 }
 
-static void gen_typed_rax_dereference(const Type *type) {
+// =============================================================================
+// Memory operands.
+// =============================================================================
+// A memory operand. It is either a rip-relative global "sym[rip+disp]" or
+// "[base+index*scale+disp]" where base and index are registers. Base is
+// always given for the latter. A stack slot without a frame pointer is
+// relative to rsp, which moves with pushes, so that its displacement is
+// fixed when it is formatted.
+typedef struct {
+    const char *sym;
+    const char *base;
+    const char *index;
+    int scale;
+    int disp;
+    bool frame;
+    const char *reg;    // A variable in a register rather than in memory.
+} Addr;
+
+// Names of the registers that can hold variables by width.
+static const char *var_regs[][4] = {
+    { "rdi", "edi", "di", "dil" },
+    { "rsi", "esi", "si", "sil" },
+    { "rdx", "edx", "dx", "dl" },
+    { "rcx", "ecx", "cx", "cl" },
+    { "r8", "r8d", "r8w", "r8b" },
+    { "r9", "r9d", "r9w", "r9b" },
+    { "r10", "r10d", "r10w", "r10b" },
+    { "r11", "r11d", "r11w", "r11b" },
+};
+
+// Name of a part of a register of a size, e.g., "edi" for 4 bytes of rdi.
+static const char *sized_reg(const char *reg, size_t siz) {
+    int width = siz == 8 ? 0 : siz == 4 ? 1 : siz == 2 ? 2 : 3;
+    for (size_t i = 0; i < sizeof(var_regs) / sizeof(var_regs[0]); i++)
+        if (strcmp(var_regs[i][0], reg) == 0)
+            return var_regs[i][width];
+    fprintf(stderr, "An unexpected register %s.\n", reg);
+    exit(1);
+}
+
+// Format a memory operand in Intel syntax, e.g., "[rbp+rax*4-16]".
+static char *addr_operand(const Addr *addr) {
+    assert(!addr->reg);
+    char *buf = malloc((addr->sym ? strlen(addr->sym) : 0) + 64);
+    if (addr->sym) {
+        if (addr->disp)
+            sprintf(buf, "%s[rip%+d]", addr->sym, addr->disp);
+        else
+            sprintf(buf, "%s[rip]", addr->sym);
+        return buf;
+    }
+    char *p = buf;
+    int disp = addr->frame ? addr->disp + stackpos : addr->disp;
+    p += sprintf(p, "[%s", addr->base);
+    if (addr->index)
+        p += sprintf(p, "+%s*%d", addr->index, addr->scale);
+    if (disp)
+        p += sprintf(p, "%+d", disp);
+    sprintf(p, "]");
+    return buf;
+}
+
+// A stack slot at an offset from the frame base, which is where rbp points
+// with a frame pointer. Without it, the base is the return address and the
+// locals take the slot of the saved rbp.
+static Addr frame_slot(int offset) {
+    if (offset < 0)
+        offset -= red_zone_shift;
+    if (!omit_frame_pointer)
+        return (Addr) { .base = "rbp", .disp = offset };
+    if (offset < 0)
+        offset += 8;
+    return (Addr) { .base = "rsp", .disp = offset - 8, .frame = true };
+}
+
+static const char *ptr_size_name(size_t siz) {
+    switch (siz) {
+    case 1:
+        return "byte ptr";
+    case 2:
+        return "word ptr";
+    case 4:
+        return "dword ptr";
+    case 8:
+        return "qword ptr";
+    default:
+        fprintf(stderr, "An unpredicted type size %zu.\n", siz);
+        exit(1);
+    }
+}
+
+// Load a value of a type from memory to rax. An array is not loaded but
+// decays to its address.
+static void gen_typed_load(const Type *type, const Addr *addr) {
+    if (addr->reg) {
+        size_t siz = get_typesize(type);
+        if (siz < 4)
+            emit("  movzx eax, %s\n", sized_reg(addr->reg, siz));
+        else
+            emit("  mov %s, %s\n", siz == 8 ? "rax" : "eax", sized_reg(addr->reg, siz));
+        return;
+    }
+    char *operand = addr_operand(addr);
+    if (type->ty == ARRAY || type->ty == STRUCT) {
+        emit("  lea rax, %s\n", operand);
+        return;
+    }
     switch(get_typesize(type)) {
     case 1:
-        printf("  movzx eax, byte ptr [rax]\n");
+        emit("  movzx eax, byte ptr %s\n", operand);
         return;
     case 2:
-        printf("  movzx eax, word ptr [rax]\n");
+        emit("  movzx eax, word ptr %s\n", operand);
         return;
     case 4:
-        printf("  mov eax, dword ptr [rax]\n");
+        emit("  mov eax, dword ptr %s\n", operand);
         return;
     case 8:
-        printf("  mov rax, qword ptr [rax]\n");
+        emit("  mov rax, qword ptr %s\n", operand);
         return;
     default:
         fprintf(stderr, "An unpredicted type size %zu.\n", get_typesize(type));
@@ -134,183 +419,1542 @@ static void gen_typed_rax_dereference(const Type *type) {
     }
 }
 
-static void gen_typed_mov_rax_to_ptr_rdi(const Type *type) {
-    size_t siz = get_typesize(type);
-    switch (siz) {
-    case 1:
-        printf("  mov byte ptr [rdi], al\n");
-        return;
-    case 2:
-        printf("  mov word ptr [rdi], ax\n");
-        return;
-    case 4:
-        printf("  mov dword ptr [rdi], eax\n");
-        return;
-    case 8:
-        printf("  mov [rdi], rax\n");
+// Blocks of up to block_inline_limit bytes are copied or zeroed by unrolled
+// moves of the widest registers that fit the rest, i.e., ymm with -mavx2 and
+// xmm otherwise, down to single bytes. Larger blocks use rep movsb and rep
+// stosb, which clobber rdi, rsi and rcx.
+static int block_move_width(size_t rest) {
+    if (use_avx2 && rest >= 32)
+        return 32;
+    for (int width = 16; width > 1; width /= 2)
+        if (rest >= (size_t)width)
+            return width;
+    return 1;
+}
+
+static const char *vector_load(int width) {
+    if (width == 32)
+        return "vmovdqu ymm0, ymmword ptr";
+    return use_avx2 ? "vmovdqu xmm0, xmmword ptr" : "movdqu xmm0, xmmword ptr";
+}
+
+static const char *vector_store(int width) {
+    if (width == 32)
+        return "vmovdqu ymmword ptr";
+    return use_avx2 ? "vmovdqu xmmword ptr" : "movdqu xmmword ptr";
+}
+
+// Copy a block of memory from the address in rax, which then points to the
+// destination. The destination must not use rax or r11, which is used as a
+// scratch.
+static void gen_block_copy(const Addr *dst, size_t size) {
+    static const char *scratch[] = { NULL, "r11b", "r11w", NULL, "r11d", NULL, NULL, NULL, "r11" };
+    if (size > (size_t)block_inline_limit) {
+        emit("  lea rdi, %s\n", addr_operand(dst));
+        emit("  mov rsi, rax\n");
+        emit("  mov ecx, %zu\n", size);
+        emit("  rep movsb\n");
+        emit("  lea rax, [rdi-%zu]\n", size);
+        return;
+    }
+
+    bool ymm = false;
+    int width;
+    for (size_t off = 0; off < size; off += width) {
+        width = block_move_width(size - off);
+        Addr src = { .base = "rax", .disp = (int)off };
+        Addr to = *dst;
+        to.disp += (int)off;
+        if (width >= 16) {
+            ymm |= width == 32;
+            emit("  %s %s\n", vector_load(width), addr_operand(&src));
+            emit("  %s %s, %s\n", vector_store(width), addr_operand(&to),
+                    width == 32 ? "ymm0" : "xmm0");
+            continue;
+        }
+        emit("  mov %s, %s %s\n", scratch[width], ptr_size_name(width), addr_operand(&src));
+        emit("  mov %s %s, %s\n", ptr_size_name(width), addr_operand(&to), scratch[width]);
+    }
+    if (ymm)
+        emit("  vzeroupper\n");
+    emit("  lea rax, %s\n", addr_operand(dst));
+}
+
+// Zero a block of memory. rax may be clobbered.
+static void gen_block_zero(const Addr *dst, size_t size) {
+    if (size > (size_t)block_inline_limit) {
+        emit("  lea rdi, %s\n", addr_operand(dst));
+        emit("  xor eax, eax\n");
+        emit("  mov ecx, %zu\n", size);
+        emit("  rep stosb\n");
+        return;
+    }
+
+    if (size >= 16)
+        emit(use_avx2 ? "  vpxor xmm0, xmm0, xmm0\n" : "  pxor xmm0, xmm0\n");
+    bool ymm = false;
+    int width;
+    for (size_t off = 0; off < size; off += width) {
+        width = block_move_width(size - off);
+        Addr to = *dst;
+        to.disp += (int)off;
+        if (width >= 16) {
+            ymm |= width == 32;
+            emit("  %s %s, %s\n", vector_store(width), addr_operand(&to),
+                    width == 32 ? "ymm0" : "xmm0");
+            continue;
+        }
+        emit("  mov %s %s, 0\n", ptr_size_name(width), addr_operand(&to));
+    }
+    if (ymm)
+        emit("  vzeroupper\n");
+}
+
+// Store rax to memory. The operand must not use rax. A struct or an array is
+// copied from the address in rax, which then points to the copy.
+static void gen_typed_store(const Type *type, const Addr *addr) {
+    static const char *regs[] = { NULL, "al", "ax", NULL, "eax", NULL, NULL, NULL, "rax" };
+    size_t siz = get_typesize(type);
+    if (type->ty == STRUCT || type->ty == ARRAY) {
+        gen_block_copy(addr, siz);
+        return;
+    }
+    if (addr->reg) {
+        emit("  mov %s, %s\n", sized_reg(addr->reg, siz), regs[siz]);
+        return;
+    }
+    emit("  mov %s %s, %s\n",
+            ptr_size_name(siz), addr_operand(addr), regs[siz]);
+}
+
+static void gen_typed_cmp_rax_to_0(const Type *type) {
+    size_t siz = get_typesize(type);
+    switch (siz) {
+    case 1:
+        emit("  cmp al, 0\n");
+        return;
+    case 2:
+        emit("  cmp ax, 0\n");
+        return;
+    case 4:
+        emit("  cmp eax, 0\n");
+        return;
+    case 8:
+        emit("  cmp rax, 0\n");
+        return;
+    default:
+        fprintf(stderr, "An unpredicted type size %zu.\n", siz);
+        exit(1);
+    }
+}
+
+static void gen_addr(const Node *node, const Map *idents, Addr *addr);
+static void gen_lval(const Node* node, const Map *idents);
+static void gen_add(int ty, Node *lhs, Node *rhs, const Map *idents);
+static void gen(const Node *node, const Map *idents);
+
+// Evaluate a controlling expression and jump to a label with a conditional
+// jump instruction jcc (e.g., "je" to jump when the expression is zero).
+static void gen_cond_jump(const Node *cond, const char *jcc, int label, const Map *idents) {
+    // A constant condition either always jumps or never does.
+    if (cond->ty == ND_NUM) {
+        if ((strcmp(jcc, "jne") == 0) == (cond->val != 0))
+            emit("  jmp .L%d\n", label);
+        return;
+    }
+    gen(cond, idents);
+    gen_typed_cmp_rax_to_0(cond->type);
+    emit("  %s .L%d\n", jcc, label);
+}
+
+// Make the address in a memory operand available in rax.
+static void gen_lea(const Addr *addr) {
+    if (!addr->sym && !addr->index && !addr->disp && strcmp(addr->base, "rax") == 0)
+        return;
+    emit("  lea rax, %s\n", addr_operand(addr));
+}
+
+// If the address of an lvalue is known without any computation, i.e., it is
+// a variable, a member of it, or its array element at a constant index,
+// describe it as a memory operand and return true.
+static bool static_addr(const Node *node, const Map *idents, Addr *addr) {
+    switch (node->ty) {
+    case ND_IDENT:
+    case ND_DECLARATION:
+    {
+        Ident *ident = (Ident *)map_get(idents, node->name);
+        if (ident) {
+            // Local variable found.
+            if (ident->reg)
+                *addr = (Addr) { .reg = ident->reg };
+            else
+                *addr = frame_slot((int)ident->offset);
+            return true;
+        }
+
+        // Local variable not found. Look for a global.
+        if (map_get(globalvars, node->name)) {
+            *addr = (Addr) { .sym = node->name };
+            return true;
+        }
+
+        fprintf(stderr, "An unknown identifier %s.\n", node->name);
+        exit(1);
+    }
+
+    case ND_MEMBER:
+        assert(node->member_of->type->ty == STRUCT);
+        if (!static_addr(node->member_of, idents, addr))
+            return false;
+        addr->disp += get_member_offset(node->member_of->type, node->mname);
+        return true;
+
+    case ND_UEXPR:
+    {
+        assert(node->uop == '*');
+        const Node *ptr = node->operand;
+        if (ptr->type->ty == ARRAY && (ptr->ty == ND_IDENT || ptr->ty == ND_MEMBER))
+            return static_addr(ptr, idents, addr);
+        if ((ptr->ty != '+' && ptr->ty != '-') || ptr->lhs->type->ty != ARRAY
+                || ptr->rhs->ty != ND_NUM)
+            return false;
+        if (!static_addr(ptr->lhs, idents, addr))
+            return false;
+        int val = ptr->ty == '+' ? ptr->rhs->val : -ptr->rhs->val;
+        addr->disp += val * (int)get_typesize(ptr->lhs->type->ptr_of);
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+// =============================================================================
+// Strength reduction of multiplication and division by constants.
+// =============================================================================
+// Number of trailing zero bits of a nonzero value.
+static int count_trailing_zeros(unsigned long long x) {
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+}
+
+// Multiply rax (eax if not wide) by a constant. Multipliers of the form
+// 2^k * {1, 3, 5, 9} are lowered to lea and shl.
+static void gen_mul_imm(bool wide, long long c) {
+    const char *ax = wide ? "rax" : "eax";
+    if (c == 0) {
+        emit("  xor eax, eax\n");
+        return;
+    }
+
+    unsigned long long m = c < 0 ? -(unsigned long long)c : (unsigned long long)c;
+    int shift = count_trailing_zeros(m);
+    m >>= shift;
+    if (m != 1 && m != 3 && m != 5 && m != 9) {
+        emit("  imul %s, %s, %lld\n", ax, ax, c);
+        return;
+    }
+    if (m > 1)
+        emit("  lea %s, [rax+rax*%llu]\n", ax, m - 1);
+    if (shift > 0)
+        emit("  shl %s, %d\n", ax, shift);
+    if (c < 0)
+        emit("  neg %s\n", ax);
+}
+
+// Magic number M and shift amount s for signed 32-bit division by d
+// (|d| >= 2), such that n/d is computed from the high half of n*M.
+// See Hacker's Delight, 10-1.
+static void signed_div_magic(int d, int *magic, int *shift) {
+    const unsigned two31 = 0x80000000u;
+    unsigned ad = d < 0 ? -(unsigned)d : (unsigned)d;
+    unsigned t = two31 + ((unsigned)d >> 31);
+    unsigned anc = t - 1 - t % ad;
+    int p = 31;
+    unsigned q1 = two31 / anc;
+    unsigned r1 = two31 - q1 * anc;
+    unsigned q2 = two31 / ad;
+    unsigned r2 = two31 - q2 * ad;
+    unsigned delta;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    unsigned m = q2 + 1;
+    *magic = (int)(d < 0 ? -m : m);
+    *shift = p - 32;
+}
+
+// Divide eax by a nonzero constant, or take the remainder if ty is '%',
+// without idiv. Rounds toward zero as C requires.
+static void gen_div_imm(int ty, int d) {
+    unsigned ad = d < 0 ? -(unsigned)d : (unsigned)d;
+
+    if (ad == 1) {
+        if (ty == '%')
+            emit("  xor eax, eax\n");
+        else if (d < 0)
+            emit("  neg eax\n");
+        return;
+    }
+
+    if ((ad & (ad - 1)) == 0) {
+        // Power of two. Add 2^k-1 to a negative dividend before shifting so
+        // that the quotient rounds toward zero.
+        int k = count_trailing_zeros(ad);
+        emit("  cltd\n");
+        emit("  shr edx, %d\n", 32 - k);
+        emit("  add eax, edx\n");
+        if (ty == '%') {
+            emit("  and eax, %u\n", ad - 1);
+            emit("  sub eax, edx\n");
+            return;
+        }
+        emit("  sar eax, %d\n", k);
+        if (d < 0)
+            emit("  neg eax\n");
+        return;
+    }
+
+    // Multiply by the magic number and take the high half.
+    int magic, shift;
+    signed_div_magic(d, &magic, &shift);
+    emit("  movsxd rdx, eax\n");
+    emit("  imul rax, rdx, %d\n", magic);
+    emit("  sar rax, 32\n");
+    if (d > 0 && magic < 0)
+        emit("  add eax, edx\n");
+    if (d < 0 && magic > 0)
+        emit("  sub eax, edx\n");
+    if (shift > 0)
+        emit("  sar eax, %d\n", shift);
+    // Add one to a negative quotient.
+    emit("  mov ecx, eax\n");
+    emit("  shr ecx, 31\n");
+    emit("  add eax, ecx\n");
+    if (ty == '%') {
+        // n - (n/d)*d. The dividend is still in edx.
+        emit("  imul eax, eax, %d\n", d);
+        emit("  sub edx, eax\n");
+        emit("  mov eax, edx\n");
+    }
+}
+
+// Prepare an index in rax to be used as "index*scale" in a memory operand
+// and return the scale. The part of the element size that a scale cannot
+// express is multiplied in advance.
+static int gen_index(const Type *idxtype, size_t elemsize, bool negate) {
+    // Indices are computed in 64 bits. Sign-extend int.
+    if (get_typesize(idxtype) == 4)
+        emit("  movsxd rax, eax\n");
+    if (negate)
+        emit("  neg rax\n");
+    int scale = 8;
+    while (elemsize % scale != 0)
+        scale /= 2;
+    if (elemsize / scale != 1)
+        gen_mul_imm(true, elemsize / scale);
+    return scale;
+}
+
+static void gen_ptr_addr(const Node *ptr, const Map *idents, Addr *addr);
+
+// Compute the address "base +/- idx" where base is a pointer or an array and
+// idx is an integer scaled by the size of the pointed type.
+static void gen_index_addr(const Node *base, const Node *idx, bool negate,
+        bool base_first, const Map *idents, Addr *addr) {
+    size_t elemsize = get_typesize(base->type->ptr_of);
+
+    // Constant index is folded into the displacement.
+    if (idx->ty == ND_NUM) {
+        gen_ptr_addr(base, idents, addr);
+        addr->disp += (negate ? -idx->val : idx->val) * (int)elemsize;
+        return;
+    }
+
+    // Array variable. Only the index needs to be computed.
+    Addr b;
+    if (base->type->ty == ARRAY && static_addr(base, idents, &b)) {
+        gen(idx, idents);
+        int scale = gen_index(idx->type, elemsize, negate);
+        if (b.sym) {
+            // rip-relative addressing does not take an index.
+            emit("  lea rdi, %s\n", addr_operand(&b));
+            b = (Addr) { .base = "rdi" };
+        }
+        *addr = b;
+        addr->index = "rax";
+        addr->scale = scale;
+        return;
+    }
+
+    // Otherwise, compute the base address to rdi and the index to rax in the
+    // order of the operands.
+    int scale;
+    if (base_first) {
+        gen_ptr_addr(base, idents, &b);
+        gen_lea(&b);
+        push("rax");
+        gen(idx, idents);
+        scale = gen_index(idx->type, elemsize, negate);
+        pop("rdi");
+    } else {
+        gen(idx, idents);
+        scale = gen_index(idx->type, elemsize, negate);
+        push("rax");
+        gen_ptr_addr(base, idents, &b);
+        gen_lea(&b);
+        emit("  mov rdi, rax\n");
+        pop("rax");
+    }
+    *addr = (Addr) { .base = "rdi", .index = "rax", .scale = scale };
+}
+
+// Compute the address that a pointer (or an array decaying to a pointer)
+// points to.
+static void gen_ptr_addr(const Node *ptr, const Map *idents, Addr *addr) {
+    if ((ptr->ty == '+' || ptr->ty == '-') && is_ptr_like(ptr->lhs->type)
+            && !is_ptr_like(ptr->rhs->type)) {
+        gen_index_addr(ptr->lhs, ptr->rhs, ptr->ty == '-', true, idents, addr);
+        return;
+    }
+    if (ptr->ty == '+' && is_ptr_like(ptr->rhs->type) && !is_ptr_like(ptr->lhs->type)) {
+        gen_index_addr(ptr->rhs, ptr->lhs, false, false, idents, addr);
+        return;
+    }
+    if (ptr->type->ty == ARRAY && ptr->ty != '+' && ptr->ty != '-') {
+        gen_addr(ptr, idents, addr);
+        return;
+    }
+    gen(ptr, idents);
+    *addr = (Addr) { .base = "rax" };
+}
+
+// Generate code to compute the address of an lvalue and describe it as a
+// memory operand. The operand uses rax and rdi only.
+static void gen_addr(const Node *node, const Map *idents, Addr *addr) {
+    if (static_addr(node, idents, addr))
+        return;
+
+    switch (node->ty) {
+    case ND_MEMBER:
+        gen_addr(node->member_of, idents, addr);
+        addr->disp += get_member_offset(node->member_of->type, node->mname);
+        return;
+
+    case ND_UEXPR:
+        assert(node->uop == '*');
+        gen_ptr_addr(node->operand, idents, addr);
+        return;
+
+    default:
+        // A struct value, e.g., returned by a call, evaluates to its address.
+        if (node->type && node->type->ty == STRUCT) {
+            gen(node, idents);
+            *addr = (Addr) { .base = "rax" };
+            return;
+        }
+        fprintf(stderr, "Attempted to generate an invalid node as an lvalue. %d.\n", node->ty);
+        exit(1);
+    }
+}
+
+static void gen_lval(const Node *node, const Map *idents) {
+    Addr addr;
+    gen_addr(node, idents, &addr);
+    gen_lea(&addr);
+}
+
+// Assign the value of rhs to an lvalue. The value stays in rax.
+static void gen_assign(const Node *lhs, const Type *type, const Node *rhs, const Map *idents) {
+    Addr addr;
+    if (static_addr(lhs, idents, &addr)) {
+        gen(rhs, idents);
+        gen_typed_store(type, &addr);
+        return;
+    }
+    gen_lval(lhs, idents);
+    push("rax");
+    gen(rhs, idents);
+    pop("rdi");
+    gen_typed_store(type, &(Addr) { .base = "rdi" });
+}
+
+// A constant or a variable of a scalar type can be an immediate or a memory
+// operand of an instruction without being evaluated through the stack.
+static bool is_simple_operand(const Node *node, const Map *idents) {
+    if (node->ty == ND_NUM)
+        return true;
+    if (node->ty != ND_IDENT && node->ty != ND_MEMBER)
+        return false;
+    if (node->type->ty != PTR && !is_basic_type(node->type))
+        return false;
+    Addr addr;
+    return static_addr(node, idents, &addr);
+}
+
+// Return a source operand string for a simple operand. A narrow variable is
+// zero-extended to rdi since it cannot be used as a memory operand as is.
+static char *gen_simple_operand(const Node *node, bool wide, const Map *idents) {
+    char *buf;
+    if (node->ty == ND_NUM) {
+        buf = malloc(16);
+        sprintf(buf, "%d", node->val);
+        return buf;
+    }
+
+    Addr addr;
+    static_addr(node, idents, &addr);
+    size_t siz = get_typesize(node->type);
+    if (addr.reg) {
+        if (siz == (wide ? 8u : 4u))
+            return (char *)sized_reg(addr.reg, siz);
+        if (siz == 4)
+            emit("  mov edi, %s\n", sized_reg(addr.reg, siz));
+        else
+            emit("  movzx edi, %s\n", sized_reg(addr.reg, siz));
+        return wide ? "rdi" : "edi";
+    }
+    char *operand = addr_operand(&addr);
+    if (siz == (wide ? 8u : 4u)) {
+        buf = malloc(strlen(operand) + 16);
+        sprintf(buf, "%s %s", ptr_size_name(siz), operand);
+        return buf;
+    }
+    if (siz == 4)
+        emit("  mov edi, dword ptr %s\n", operand);
+    else
+        emit("  movzx edi, %s %s\n", ptr_size_name(siz), operand);
+    return wide ? "rdi" : "edi";
+}
+
+static bool is_comparison(int ty) {
+    return ty == '<' || ty == '>' || ty == ND_LESSEQUAL || ty == ND_GREATEREQUAL
+        || ty == ND_EQUAL || ty == ND_NOTEQUAL;
+}
+
+// Return the operator that gives the same result when the operands are
+// swapped, or 0 if there is none.
+static int swapped_operator(int ty) {
+    switch (ty) {
+    case '+':
+    case '*':
+    case '|':
+    case '^':
+    case '&':
+    case ND_EQUAL:
+    case ND_NOTEQUAL:
+        return ty;
+    case '<':
+        return '>';
+    case '>':
+        return '<';
+    case ND_LESSEQUAL:
+        return ND_GREATEREQUAL;
+    case ND_GREATEREQUAL:
+        return ND_LESSEQUAL;
+    default:
+        return 0;
+    }
+}
+
+// Generate an integer binary operator. If either operand is a constant or a
+// variable, it is used as an immediate or a memory operand.
+static void gen_binop(int ty, const Type *type, const Node *lhs, const Node *rhs, const Map *idents) {
+    // Bring a simple operand to the right side if the operator allows.
+    int swapped = swapped_operator(ty);
+    if (swapped && is_simple_operand(lhs, idents) && !is_simple_operand(rhs, idents)) {
+        const Node *tmp = lhs;
+        lhs = rhs;
+        rhs = tmp;
+        ty = swapped;
+    }
+
+    // Operation width. Comparisons take the wider operand.
+    bool wide = get_typesize(type) == 8;
+    if (is_comparison(ty))
+        wide = get_typesize(lhs->type) == 8 || get_typesize(rhs->type) == 8;
+    const char *ax = wide ? "rax" : "eax";
+
+    const char *src;
+    gen(lhs, idents);
+
+    // Multiplication and division by constants.
+    if (rhs->ty == ND_NUM && ty == '*') {
+        gen_mul_imm(wide, rhs->val);
+        return;
+    }
+    if (rhs->ty == ND_NUM && rhs->val != 0 && !wide && (ty == '/' || ty == '%')) {
+        gen_div_imm(ty, rhs->val);
+        return;
+    }
+
+    if (is_simple_operand(rhs, idents)) {
+        src = gen_simple_operand(rhs, wide, idents);
+    } else {
+        push("rax");
+        gen(rhs, idents);
+        emit("  mov rdi, rax\n");
+        pop("rax");
+        src = wide ? "rdi" : "edi";
+    }
+
+    switch (ty) {
+    case '+':
+        emit("  add %s, %s\n", ax, src);
+        return;
+    case '-':
+        emit("  sub %s, %s\n", ax, src);
+        return;
+    case '|':
+        emit("  or %s, %s\n", ax, src);
+        return;
+    case '^':
+        emit("  xor %s, %s\n", ax, src);
+        return;
+    case '&':
+        emit("  and %s, %s\n", ax, src);
+        return;
+    case '*':
+        emit("  imul %s, %s\n", ax, src);
+        return;
+    case '/':
+    case '%':
+        if (rhs->ty == ND_NUM) {
+            emit("  mov edi, %s\n", src);
+            src = wide ? "rdi" : "edi";
+        }
+        emit(wide ? "  cqto\n" : "  cltd\n");
+        emit("  idiv %s\n", src);
+        if (ty == '%')
+            emit("  mov %s, %s\n", ax, wide ? "rdx" : "edx");
+        return;
+    }
+
+    const char *setcc;
+    switch (ty) {
+    case '<':
+        setcc = "setl";
+        break;
+    case '>':
+        setcc = "setg";
+        break;
+    case ND_LESSEQUAL:
+        setcc = "setle";
+        break;
+    case ND_GREATEREQUAL:
+        setcc = "setge";
+        break;
+    case ND_EQUAL:
+        setcc = "sete";
+        break;
+    case ND_NOTEQUAL:
+        setcc = "setne";
+        break;
+    default:
+        fprintf(stderr, "An unexpected operator type %d during assembly generation.\n", ty);
+        exit(1);
+    }
+    emit("  cmp %s, %s\n", ax, src);
+    emit("  %s al\n", setcc);
+    emit("  movzb rax, al\n");
+}
+
+static void gen_add(int ty, Node *lhs, Node *rhs, const Map *idents) {
+    assert(ty == '+' || ty == '-');
+    assert(lhs->type);
+    assert(rhs->type);
+
+    bool lhs_is_ptr = is_ptr_like(lhs->type);
+    bool rhs_is_ptr = is_ptr_like(rhs->type);
+    if (lhs_is_ptr && rhs_is_ptr) {
+        fprintf(stderr, "Pointer +/- pointer operation not supported (yet).\n");
+        exit(1);
+    }
+    if (rhs_is_ptr && ty == '-') {
+        fprintf(stderr, "Integer - pointer operation is invalid.\n");
+        exit(1);
+    }
+
+    // Pointer arithmatic is an address computation.
+    if (lhs_is_ptr || rhs_is_ptr) {
+        Addr addr;
+        if (lhs_is_ptr)
+            gen_index_addr(lhs, rhs, ty == '-', true, idents, &addr);
+        else
+            gen_index_addr(rhs, lhs, false, false, idents, &addr);
+        gen_lea(&addr);
+        return;
+    }
+
+    // Integer type.
+    gen_binop(ty, deduce_type(ty, lhs, rhs), lhs, rhs, idents);
+}
+
+// =============================================================================
+// Vectorized loops.
+//
+// The index is kept in rcx and the limit in rdx. The array bases get the
+// registers below. Subexpressions are computed in vector registers from 0 by
+// depth, invariant operands are broadcast to registers from 8, register 7
+// holds zeros and register 15 accumulates a sum.
+// =============================================================================
+static const char *vbase_regs[] = { "rsi", "rdi", "r8", "r9", "r10", "r11" };
+static Vector *vbases;      // Names of the array bases.
+static Vector *vscalars;    // Invariant operands.
+
+static const char *vreg(int n) {
+    static char bufs[4][8];
+    static int next = 0;
+    char *buf = bufs[next++ % 4];
+    sprintf(buf, "%smm%d", use_avx2 ? "y" : "x", n);
+    return buf;
+}
+
+// Emit "op dst, src", or its three-operand AVX form.
+static void emit_vop(const char *op, int dst, int src) {
+    if (use_avx2)
+        emit("  v%s %s, %s, %s\n", op, vreg(dst), vreg(dst), vreg(src));
+    else
+        emit("  %s %s, %s\n", op, vreg(dst), vreg(src));
+}
+
+static const Node *vload_base(const Node *node) {
+    if (node->ty != ND_UEXPR || node->uop != '*')
+        return NULL;
+    const Node *ptr = node->operand;
+    return is_ptr_like(ptr->lhs->type) ? ptr->lhs : ptr->rhs;
+}
+
+static int vector_index(const Vector *v, const Node *node) {
+    if (node->ty != ND_NUM && node->ty != ND_IDENT)
+        return -1;
+    for (int i = 0; i < v->len; i++) {
+        const Node *other = (const Node *)v->data[i];
+        if (node->ty == ND_NUM ? other->ty == ND_NUM && other->val == node->val
+                : other->ty == ND_IDENT && strcmp(other->name, node->name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void collect_voperands(const Node *node) {
+    const Node *base = vload_base(node);
+    if (base) {
+        if (vector_index(vbases, base) < 0)
+            vec_push(vbases, base);
+        return;
+    }
+    if (node->ty == ND_NUM || node->ty == ND_IDENT) {
+        if (vector_index(vscalars, node) < 0)
+            vec_push(vscalars, node);
+        return;
+    }
+    collect_voperands(node->lhs);
+    collect_voperands(node->rhs);
+}
+
+static const char *velem_operand(const Node *base, int size) {
+    static char buf[64];
+    sprintf(buf, "%s [%s+rcx*%d]", use_avx2 ? "ymmword ptr" : "xmmword ptr",
+        vbase_regs[vector_index(vbases, base)], size);
+    return buf;
+}
+
+static const char *vop_name(int ty, int size) {
+    switch (ty) {
+    case '+':
+        return size == 1 ? "paddb" : size == 2 ? "paddw" : "paddd";
+    case '-':
+        return size == 1 ? "psubb" : size == 2 ? "psubw" : "psubd";
+    case '*':
+        return size == 2 ? "pmullw" : "pmulld";
+    case '&':
+        return "pand";
+    case '|':
+        return "por";
+    case '^':
+        return "pxor";
+    default:
+        fprintf(stderr, "An unexpected vector operator %d.\n", ty);
+        exit(1);
+    }
+}
+
+// Compute an expression in lanes of a size into vector register r.
+static void gen_vexpr(const Node *node, int size, int r) {
+    const char *mov = use_avx2 ? "vmovdqu" : "movdqu";
+    const Node *base = vload_base(node);
+    if (base) {
+        emit("  %s %s, %s\n", mov, vreg(r), velem_operand(base, size));
+        return;
+    }
+    int k = vector_index(vscalars, node);
+    if (k >= 0) {
+        emit("  %s %s, %s\n", use_avx2 ? "vmovdqa" : "movdqa", vreg(r), vreg(8 + k));
+        return;
+    }
+    gen_vexpr(node->lhs, size, r);
+    k = vector_index(vscalars, node->rhs);
+    if (k >= 0) {
+        emit_vop(vop_name(node->ty, size), r, 8 + k);
+        return;
+    }
+    gen_vexpr(node->rhs, size, r + 1);
+    emit_vop(vop_name(node->ty, size), r, r + 1);
+}
+
+// Broadcast eax to the lanes of a size of a vector register.
+static void gen_broadcast(int r, int size) {
+    if (use_avx2) {
+        emit("  vmovd xmm%d, eax\n", r);
+        emit("  vpbroadcast%c %s, xmm%d\n", size == 1 ? 'b' : size == 2 ? 'w' : 'd', vreg(r), r);
+        return;
+    }
+    emit("  movd xmm%d, eax\n", r);
+    if (size == 1)
+        emit("  punpcklbw xmm%d, xmm%d\n", r, r);
+    if (size <= 2)
+        emit("  punpcklwd xmm%d, xmm%d\n", r, r);
+    emit("  pshufd xmm%d, xmm%d, 0\n", r, r);
+}
+
+// Add the elements in register 0 to the sum in register 15 as int lanes.
+// Narrow elements are zero-extended as loads are.
+static void gen_vaccumulate(int size) {
+    switch (size) {
+    case 1:
+        // Sums of 8 bytes each in 64-bit lanes.
+        emit_vop("psadbw", 0, 7);
+        break;
+    case 2:
+        emit("  %s %s, %s\n", use_avx2 ? "vmovdqa" : "movdqa", vreg(1), vreg(0));
+        emit_vop("punpcklwd", 0, 7);
+        emit_vop("punpckhwd", 1, 7);
+        emit_vop("paddd", 15, 1);
+        break;
+    }
+    emit_vop("paddd", 15, 0);
+}
+
+static void gen_vloop(const Node *node, const Map *idents) {
+    const Node *stmt = node->vstmt;
+    const Node *sum = stmt->lhs->ty == ND_IDENT ? stmt->lhs : NULL;
+    const Node *expr = stmt->rhs;
+    int size;
+    if (sum) {
+        expr = expr->lhs->ty == ND_IDENT && strcmp(expr->lhs->name, sum->name) == 0
+            ? expr->rhs : expr->lhs;
+        size = vload_base(expr) ? (int)get_typesize(expr->type) : 4;
+    } else {
+        size = (int)get_typesize(stmt->lhs->type);
+    }
+    int lanes = (use_avx2 ? 32 : 16) / size;
+
+    vbases = new_vector();
+    vscalars = new_vector();
+    if (!sum)
+        collect_voperands(stmt->lhs);
+    collect_voperands(expr);
+
+    // Operands are variables or constants, which gen() loads to rax only.
+    gen(node->vindex, idents);
+    emit("  movsxd rcx, eax\n");
+    gen(node->vlimit, idents);
+    emit("  movsxd rdx, eax\n");
+    for (int i = 0; i < vbases->len; i++) {
+        gen((const Node *)vbases->data[i], idents);
+        emit("  mov %s, rax\n", vbase_regs[i]);
+    }
+    for (int i = 0; i < vscalars->len; i++) {
+        gen((const Node *)vscalars->data[i], idents);
+        gen_broadcast(8 + i, size);
+    }
+    if (sum) {
+        emit_vop("pxor", 15, 15);
+        emit_vop("pxor", 7, 7);
+    }
+
+    int lbl_body = nlabel++;
+    int lbl_end = nlabel++;
+    emit("  lea rax, [rcx+%d]\n", lanes);
+    emit("  cmp rax, rdx\n");
+    emit("  jg .L%d\n", lbl_end);
+    emit("  .p2align 4\n");
+    emit(".L%d:\n", lbl_body);
+    gen_vexpr(expr, size, 0);
+    if (sum)
+        gen_vaccumulate(size);
+    else
+        emit("  %s %s, %s\n", use_avx2 ? "vmovdqu" : "movdqu",
+            velem_operand(vload_base(stmt->lhs), size), vreg(0));
+    emit("  add rcx, %d\n", lanes);
+    emit("  lea rax, [rcx+%d]\n", lanes);
+    emit("  cmp rax, rdx\n");
+    emit("  jle .L%d\n", lbl_body);
+    emit(".L%d:\n", lbl_end);
+
+    Addr addr;
+    if (sum) {
+        // Add up the lanes.
+        if (use_avx2) {
+            emit("  vextracti128 xmm0, ymm15, 1\n");
+            emit("  vpaddd xmm15, xmm15, xmm0\n");
+            emit("  vzeroupper\n");
+        }
+        emit("  pshufd xmm0, xmm15, 78\n");
+        emit("  paddd xmm15, xmm0\n");
+        emit("  pshufd xmm0, xmm15, 177\n");
+        emit("  paddd xmm15, xmm0\n");
+        emit("  movd edi, xmm15\n");
+        gen(sum, idents);
+        emit("  add eax, edi\n");
+        static_addr(sum, idents, &addr);
+        gen_typed_store(sum->type, &addr);
+    } else if (use_avx2) {
+        emit("  vzeroupper\n");
+    }
+    emit("  mov eax, ecx\n");
+    static_addr(node->vindex, idents, &addr);
+    gen_typed_store(node->vindex->type, &addr);
+}
+
+// =============================================================================
+// Function calls.
+//
+// Arguments passed in registers that need no computation, such as constants,
+// variables and their addresses, are loaded into the registers after the
+// other arguments are popped instead of going through the stack.
+//
+// A function that makes calls reserves an outgoing argument area at the
+// bottom of its frame and keeps the stack pointer aligned there. A call made
+// with nothing pushed stores its stack arguments to the area and leaves the
+// stack pointer alone. Calls made in the middle of an expression push their
+// stack arguments and align the stack pointer themselves.
+// =============================================================================
+// Stack position at which the outgoing argument area is at the top of the
+// stack, or -1 in a function without calls.
+static int out_base = -1;
+
+// A slot in the outgoing argument area.
+static Addr out_slot(int offset) {
+    return (Addr) { .base = "rsp", .disp = offset - out_base, .frame = true };
+}
+
+// The slot receiving the struct returned by a call.
+static Addr ret_slot(const Node *call, const Map *idents) {
+    for (int i = 0; i < ret_calls->len; i++) {
+        if (ret_calls->data[i] == call) {
+            Ident *ident = (Ident *)map_get(idents, ret_names->data[i]);
+            return frame_slot((int)ident->offset);
+        }
+    }
+    fprintf(stderr, "A call returning a struct without a slot.\n");
+    exit(1);
+}
+
+// Store an evaluated argument to the outgoing argument area.
+static void gen_store_arg(const Type *type, int offset) {
+    Addr slot = out_slot(offset);
+    if (type->ty == STRUCT)
+        gen_block_copy(&slot, get_typesize(type));
+    else
+        emit("  mov qword ptr %s, rax\n", addr_operand(&slot));
+}
+
+static bool is_direct_arg(const Node *arg, const Map *idents) {
+    Addr addr;
+    if (arg->ty == ND_UEXPR && arg->uop == '&')
+        return static_addr(arg->operand, idents, &addr) && !addr.reg;
+    if (arg->ty == ND_IDENT && arg->type->ty == ARRAY)
+        return static_addr(arg, idents, &addr);
+    return is_simple_operand(arg, idents);
+}
+
+// Load an argument into a register. A value wider than its parameter is
+// loaded only as wide as the parameter.
+static void gen_direct_arg(const Node *arg, const Type *param, const char *reg,
+        const Map *idents) {
+    if (arg->ty == ND_NUM) {
+        if (arg->val >= 0)
+            emit("  mov %s, %d\n", sized_reg(reg, 4), arg->val);
+        else
+            emit("  mov %s, %d\n", reg, arg->val);
+        return;
+    }
+
+    Addr addr;
+    if (arg->ty == ND_UEXPR || arg->type->ty == ARRAY) {
+        static_addr(arg->ty == ND_UEXPR ? arg->operand : arg, idents, &addr);
+        emit("  lea %s, %s\n", reg, addr_operand(&addr));
+        return;
+    }
+
+    static_addr(arg, idents, &addr);
+    size_t siz = get_typesize(arg->type);
+    if (param && is_basic_type(param) && is_basic_type(arg->type)
+            && get_typesize(param) < siz)
+        siz = get_typesize(param);
+    char *src;
+    if (addr.reg) {
+        src = (char *)sized_reg(addr.reg, siz);
+    } else {
+        char *operand = addr_operand(&addr);
+        src = malloc(strlen(operand) + 16);
+        sprintf(src, "%s %s", ptr_size_name(siz), operand);
+    }
+    if (siz < 4)
+        emit("  movzx %s, %s\n", sized_reg(reg, 4), src);
+    else
+        emit("  mov %s, %s\n", sized_reg(reg, siz), src);
+}
+
+// The callee leaves the bits of rax beyond a char or short return value
+// undefined.
+static void gen_call_result(const Type *type) {
+    if (type->ty == CHAR)
+        emit("  movzx eax, al\n");
+    else if (type->ty == SHORT)
+        emit("  movzx eax, ax\n");
+}
+
+static void gen_call(const Node *node, const Map *idents) {
+    int nargs = node->fargs->len;
+    bool sret = is_memory_class(node->type);
+    ArgLoc *locs = malloc(sizeof(ArgLoc) * (nargs + 1));
+    int stack_size = classify_args(node->fargs, sret, locs);
+    bool in_area = stackpos == out_base;
+
+    // Align stack pointer to 16 bytes.
+    int orig_stackpos = stackpos;
+    // The return address makes the stack pointer 8 bytes off at entry.
+    bool align_stack = !in_area && (stackpos + stack_size) % 16 != 8;
+    if (align_stack) {
+        emit("  sub rsp, 8\n");
+        stackpos += 8;
+    }
+
+    // Without the outgoing argument area, stack arguments are pushed in
+    // place before the others are evaluated.
+    if (!in_area) {
+        for (int i = nargs - 1; i >= 0; i--) {
+            if (locs[i].reg >= 0)
+                continue;
+            const Node *arg = node->fargs->data[i];
+            gen(arg, idents);
+            if (arg->type->ty != STRUCT) {
+                push("rax");
+                continue;
+            }
+            for (int off = (int)get_typesize(arg->type) - 8; off >= 0; off -= 8)
+                push(addr_operand(&(Addr) { .base = "rax", .disp = off }));
+        }
+    }
+
+    // Evaluate argument expressions except those loaded directly. Calls in
+    // arguments reuse the outgoing argument area, so arguments containing
+    // them are evaluated before any is stored there.
+    int *pushed = malloc(sizeof(int) * (nargs + 1));
+    int npushed = 0;
+    if (in_area) {
+        for (int i = nargs - 1; i >= 0; i--) {
+            if (!has_call(node->fargs->data[i]))
+                continue;
+            gen(node->fargs->data[i], idents);
+            push("rax");
+            pushed[npushed++] = i;
+        }
+    }
+    for (int i = nargs - 1; i >= 0; i--) {
+        const Node *arg = node->fargs->data[i];
+        if ((in_area && has_call(arg)) || (!in_area && locs[i].reg < 0)
+                || (locs[i].reg >= 0 && is_direct_arg(arg, idents)))
+            continue;
+        gen(arg, idents);
+        if (locs[i].reg < 0) {
+            gen_store_arg(arg->type, locs[i].offset);
+            continue;
+        }
+        push("rax");
+        pushed[npushed++] = i;
+    }
+
+    // Store the rest of stack args before assigning any register, which
+    // copying a large struct may clobber.
+    for (int k = npushed - 1; k >= 0; k--) {
+        int i = pushed[k];
+        if (locs[i].reg >= 0)
+            continue;
+        emit("  mov rax, qword ptr [rsp+%d]\n", 8 * (npushed - 1 - k));
+        gen_store_arg(((Node *)node->fargs->data[i])->type, locs[i].offset);
+    }
+
+    // Assign args to registers. A struct is loaded 8 bytes per register from
+    // its address.
+    for (int k = npushed - 1; k >= 0; k--) {
+        int i = pushed[k];
+        const Type *type = ((Node *)node->fargs->data[i])->type;
+        if (locs[i].reg >= 0 && type->ty != STRUCT) {
+            pop(arg_regs[locs[i].reg]);
+            continue;
+        }
+        pop("rax");
+        if (locs[i].reg < 0)
+            continue;
+        for (int off = 0; off < (int)get_typesize(type); off += 8)
+            emit("  mov %s, qword ptr %s\n", arg_regs[locs[i].reg + off / 8],
+                    addr_operand(&(Addr) { .base = "rax", .disp = off }));
+    }
+    const Node *sig = map_get(functions, node->name);
+    for (int i = 0; i < nargs; i++) {
+        if (locs[i].reg < 0 || !is_direct_arg(node->fargs->data[i], idents))
+            continue;
+        const Type *param = sig && i < sig->fargs->len
+            ? ((Node *)sig->fargs->data[i])->type : NULL;
+        gen_direct_arg(node->fargs->data[i], param, arg_regs[locs[i].reg], idents);
+    }
+    if (sret) {
+        Addr slot = ret_slot(node, idents);
+        emit("  lea rdi, %s\n", addr_operand(&slot));
+    }
+
+    // A variadic function takes the number of vector registers used in al.
+    if (node->variadic)
+        emit("  xor eax, eax\n");
+    emit("  call %s\n", node->name);
+    if (node->type->ty == STRUCT) {
+        // A returned struct is stored and evaluates to its address.
+        Addr slot = ret_slot(node, idents);
+        for (int off = 0; !sret && off < (int)get_typesize(node->type); off += 8) {
+            Addr to = slot;
+            to.disp += off;
+            emit("  mov qword ptr %s, %s\n", addr_operand(&to), off == 0 ? "rax" : "rdx");
+        }
+        emit("  lea rax, %s\n", addr_operand(&slot));
+    } else {
+        gen_call_result(node->type);
+    }
+
+    // Remove stack-passed args.
+    if (!in_area && stack_size > 0) {
+        emit("  add rsp, %d\n", stack_size);
+        stackpos -= stack_size;
+    }
+
+    if (align_stack) {
+        emit("  add rsp, 8\n");
+        stackpos -= 8;
+    }
+    assert(stackpos == orig_stackpos);
+}
+
+// =============================================================================
+// Tail calls.
+//
+// A call in a return statement reuses the frame of the caller. A call to the
+// function itself assigns the arguments to the parameters and jumps back to
+// the start of the body. Any other call gets its arguments in the registers
+// and the incoming stack argument area, tears down the frame and jumps to the
+// callee, which returns directly to our caller.
+// =============================================================================
+// Function being generated and the label at the start of its body.
+static const Node *cur_func;
+static int lbl_start;
+
+// The frame cannot be reused if the address of a local variable may be used
+// by the callee.
+static bool frame_reusable;
+
+// Release the frame. The stack pointer then points to the return address.
+static void gen_epilogue(void) {
+    if (!omit_frame_pointer) {
+        emit("  mov rsp, rbp\n");
+        emit("  pop rbp\n");
+    } else if (stackpos > 0) {
+        emit("  add rsp, %d\n", stackpos);
+    }
+}
+
+static int nstackparams(void) {
+    int nparams = cur_func->fargs->len;
+    return nparams <= 6 ? 0 : nparams - 6;
+}
+
+static bool is_tail_call(const Node *call) {
+    if (!frame_reusable || !has_simple_params(cur_func) || call->type->ty == STRUCT)
+        return false;
+    for (int i = 0; i < call->fargs->len; i++)
+        if (((Node *)call->fargs->data[i])->type->ty == STRUCT)
+            return false;
+    // Our caller would not extend a narrower return value.
+    if (get_typesize(call->type) < get_typesize(cur_func->type))
+        return false;
+    int nargs = call->fargs->len;
+    if (strcmp(call->name, cur_func->fname) == 0 && nargs == cur_func->fargs->len)
+        return true;
+    return (nargs <= 6 ? 0 : nargs - 6) <= nstackparams();
+}
+
+static void gen_tail_call(const Node *call, const Map *idents) {
+    int nargs = call->fargs->len;
+    int nregargs = nargs <= 6 ? nargs : 6;
+    int nstackargs = nargs - nregargs;
+    char *regs[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+
+    // Evaluate all arguments before any of the parameters is overwritten.
+    for (int i = nargs - 1; i >= 0; i--) {
+        gen(call->fargs->data[i], idents);
+        push("rax");
+    }
+
+    if (strcmp(call->name, cur_func->fname) == 0 && nargs == cur_func->fargs->len) {
+        for (int i = 0; i < nargs; i++) {
+            pop("rax");
+            Node *param = (Node *)cur_func->fargs->data[i];
+            Ident *ident = (Ident *)map_get(idents, param->name);
+            Addr addr = frame_slot((int)ident->offset);
+            gen_typed_store(ident->type, &addr);
+        }
+        emit("  jmp .L%d\n", lbl_start);
+        return;
+    }
+
+    for (int i = 0; i < nregargs; i++)
+        pop(regs[i]);
+    for (int i = 0; i < nstackargs; i++) {
+        pop("rax");
+        Addr addr = frame_slot(8 * (i + 2));
+        emit("  mov %s, rax\n", addr_operand(&addr));
+    }
+    if (call->variadic)
+        emit("  xor eax, eax\n");
+    gen_epilogue();
+    emit("  jmp %s\n", call->name);
+}
+
+// Return a struct in rax and rdx, or copy it to the memory given by the
+// caller and return its address.
+static void gen_struct_return(const Node *value, const Map *idents) {
+    size_t size = get_typesize(value->type);
+    gen(value, idents);
+    if (is_memory_class(value->type)) {
+        Addr sret = frame_slot((int)((Ident *)map_get(idents, ".sret"))->offset);
+        emit("  mov rdi, qword ptr %s\n", addr_operand(&sret));
+        gen_block_copy(&(Addr) { .base = "rdi" }, size);
         return;
-    default:
-        fprintf(stderr, "An unpredicted type size %zu.\n", siz);
-        exit(1);
     }
+    if (size > 8)
+        emit("  mov rdx, qword ptr [rax+8]\n");
+    if (size > 0)
+        emit("  mov rax, qword ptr [rax]\n");
 }
 
-static void gen_typed_cmp_rax_to_0(const Type *type) {
-    size_t siz = get_typesize(type);
-    switch (siz) {
-    case 1:
-        printf("  cmp al, 0\n");
-        return;
-    case 2:
-        printf("  cmp ax, 0\n");
-        return;
-    case 4:
-        printf("  cmp eax, 0\n");
-        return;
-    case 8:
-        printf("  cmp rax, 0\n");
-        return;
-    default:
-        fprintf(stderr, "An unpredicted type size %zu.\n", siz);
-        exit(1);
+// =============================================================================
+// Switch statements.
+//
+// The case values are sorted and split into clusters from the lowest one:
+// a dense range of at least MIN_TABLE_CASES values, of which at least 40%
+// are cases, jumps through a table of label offsets in .rodata; a range of
+// up to 64 values going to a few labels, each from enough cases to pay off,
+// tests the bit of the value in a mask for each label; and any other value
+// is compared alone. A range that covers more cases wins, and bit tests win a
+// tie as they do not load from memory. Clusters are searched with a balanced
+// binary tree of comparisons down to a few, which are tried in order.
+// Consecutive labels share the position they label.
+// =============================================================================
+#define MIN_TABLE_CASES 4
+#define MAX_TABLE_RANGE 4096
+#define MAX_LINEAR_CLUSTERS 3
+
+typedef struct {
+    int val;
+    int label;
+} Case;
+
+typedef struct {
+    enum { CL_CASE, CL_TABLE, CL_BITS } kind;
+    int first;      // Indices of the first and the last cases.
+    int last;
+} Cluster;
+
+typedef struct {
+    int label;
+    Vector *targets;    // Labels of the values from the lowest one.
+} JumpTable;
+
+// Jump tables of the current function, printed after its code.
+static Vector *jump_tables;
+
+// Labels of the innermost switch statement by their nodes, where the label
+// is -1 for all but the first of consecutive ones.
+static Vector *label_nodes;
+static Vector *label_numbers;
+
+// Label that a break statement jumps to.
+static int break_label;
+
+static int count_targets(const Case *cases, int n) {
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        int j = 0;
+        while (j < i && cases[j].label != cases[i].label)
+            j++;
+        if (j == i)
+            count++;
     }
+    return count;
 }
 
-static void gen_lval(const Node* node, const Map *idents);
-static void gen_add(int ty, Node *lhs, Node *rhs, const Map *idents);
-static void gen(const Node *node, const Map *idents);
-
-static void gen_lval(const Node *node, const Map *idents) {
-#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
-    switch (node->ty) {
-    case ND_IDENT:
-    case ND_DECLARATION:
-    {
-        Ident *ident = (Ident *)map_get(idents, node->name);
-        if (ident) {
-            // Local variable found.
-            int offset = ident->offset;
-            printf("  lea rax, [rbp%+d]\n", offset);
-            return;
-        }
+// Return true if bit tests for cases going to a number of labels cost less
+// than comparing the cases one by one.
+static bool bit_tests_pay(int ncases, int ntargets) {
+    return (ntargets == 1 && ncases >= 3) || (ntargets == 2 && ncases >= 5)
+        || (ntargets == 3 && ncases >= 6);
+}
 
-        // Local variable not found. Look for a global.
-        Node *var = (Node *)map_get(globalvars, node->name);
-        Type *type = var->type;
-        if (type) {
-            printf("  lea rax, dword ptr %s[rip]\n", node->name);
-            return;
+static int find_clusters(const Case *cases, int n, Cluster *clusters) {
+    int m = 0;
+    for (int i = 0; i < n; ) {
+        int table = i;
+        int bits = i;
+        for (int j = i + 1; j < n; j++) {
+            long long range = (long long)cases[j].val - cases[i].val + 1;
+            if (range > MAX_TABLE_RANGE)
+                break;
+            if ((j - i + 1) * 10 >= range * 4)
+                table = j;
+            if (range <= 64 && bit_tests_pay(j - i + 1, count_targets(cases + i, j - i + 1)))
+                bits = j;
         }
-
-        fprintf(stderr, "An unknown identifier %s.\n", node->name);
-        exit(1);
+        Cluster c = { CL_CASE, i, i };
+        if (bits > i && bits >= table)
+            c = (Cluster) { CL_BITS, i, bits };
+        else if (table - i + 1 >= MIN_TABLE_CASES)
+            c = (Cluster) { CL_TABLE, i, table };
+        clusters[m++] = c;
+        i = c.last + 1;
     }
+    return m;
+}
 
-    case ND_MEMBER:
-    {
-        assert(node->member_of);
-        assert(node->member_of->type->ty == STRUCT);
-        gen_lval(node->member_of, idents);
-        int offset = get_member_offset(node->member_of->type, node->mname);
-        printf("  add rax, %d\n", offset);
+// Jump to the label of the value in eax if it is in a cluster, or to the
+// default label if it is in the range of the cluster but not a case.
+// Otherwise, fall through, or jump to the default label if last is true.
+static void gen_cluster(const Case *cases, const Cluster *c, int lbl_default, bool last) {
+    int lo = cases[c->first].val;
+    int hi = cases[c->last].val;
+    if (c->kind == CL_CASE) {
+        emit("  cmp eax, %d\n", lo);
+        emit("  je .L%d\n", cases[c->first].label);
+        if (last)
+            emit("  jmp .L%d\n", lbl_default);
         return;
     }
 
-    case ND_UEXPR:
-        assert(node->uop == '*');
-        if (node->operand->type->ty == ARRAY) {
-            // An array. Keep address itself.
-            gen_lval(node->operand, idents);
-        } else {
-            // A pointer. Take the content and treat it as an address.
-            gen(node->operand, idents);
+    int lbl_next = last ? lbl_default : nlabel++;
+    emit("  mov r11d, eax\n");
+    if (lo != 0)
+        emit("  sub r11d, %d\n", lo);
+    emit("  cmp r11d, %u\n", (unsigned)hi - (unsigned)lo);
+    emit("  ja .L%d\n", lbl_next);
+
+    if (c->kind == CL_TABLE) {
+        JumpTable *table = calloc(1, sizeof(JumpTable));
+        table->label = nlabel++;
+        table->targets = new_vector();
+        int k = c->first;
+        for (long long v = lo; v <= hi; v++) {
+            int label = lbl_default;
+            if (cases[k].val == v)
+                label = cases[k++].label;
+            vec_push(table->targets, (void *)(size_t)label);
         }
-        return;
+        vec_push(jump_tables, table);
+        emit("  lea r10, .L%d[rip]\n", table->label);
+        emit("  movsxd r11, dword ptr [r10+r11*4]\n");
+        emit("  add r11, r10\n");
+        emit("  jmp r11\n");
+    } else {
+        for (int i = c->first; i <= c->last; i++) {
+            if (count_targets(cases + c->first, i - c->first + 1)
+                    == count_targets(cases + c->first, i - c->first))
+                continue;   // Tested with an earlier case.
+            unsigned long long mask = 0;
+            for (int j = i; j <= c->last; j++)
+                if (cases[j].label == cases[i].label)
+                    mask |= 1ull << ((unsigned)cases[j].val - (unsigned)lo);
+            emit("  mov r10, %llu\n", mask);
+            emit("  bt r10, r11\n");
+            emit("  jc .L%d\n", cases[i].label);
+        }
+        emit("  jmp .L%d\n", lbl_default);
+    }
+    if (!last)
+        emit(".L%d:\n", lbl_next);
+}
 
-    case '+':
-    case '-':   // Fall through.
-        gen_add(node->ty, node->lhs, node->rhs, idents);
+static void gen_cluster_tree(const Case *cases, const Cluster *clusters, int n, int lbl_default) {
+    if (n <= MAX_LINEAR_CLUSTERS) {
+        for (int i = 0; i < n; i++)
+            gen_cluster(cases, &clusters[i], lbl_default, i == n - 1);
+        if (n == 0)
+            emit("  jmp .L%d\n", lbl_default);
         return;
-
-    default:
-        fprintf(stderr, "Attempted to generate an invalid node as an lvalue. %d.\n", node->ty);
-        exit(1);
     }
+    int mid = n / 2;
+    int lbl_upper = nlabel++;
+    emit("  cmp eax, %d\n", cases[clusters[mid].first].val);
+    emit("  jge .L%d\n", lbl_upper);
+    gen_cluster_tree(cases, clusters, mid, lbl_default);
+    emit(".L%d:\n", lbl_upper);
+    gen_cluster_tree(cases, clusters + mid, n - mid, lbl_default);
 }
 
-static void gen_add(int ty, Node *lhs, Node *rhs, const Map *idents) {
-    assert(ty == '+' || ty == '-');
-    assert(lhs->type);
-    assert(rhs->type);
+static void gen_switch(const Node *node, const Map *idents) {
+    int lbl_end = nlabel++;
+    int lbl_default = lbl_end;
+    Vector *stmts = node->then->stmts;
+    Vector *nodes = new_vector();
+    Vector *numbers = new_vector();
+    Case *cases = malloc(sizeof(Case) * (stmts->len + 1));
+    int ncases = 0;
+    int label = -1;
+    for (int i = 0; i < stmts->len; i++) {
+        const Node *stmt = (Node *)stmts->data[i];
+        if (stmt->ty != ND_CASE && stmt->ty != ND_DEFAULT) {
+            label = -1;
+            continue;
+        }
+        vec_push(nodes, stmt);
+        vec_push(numbers, (void *)(size_t)(label < 0 ? nlabel : -1));
+        if (label < 0)
+            label = nlabel++;
+        if (stmt->ty == ND_DEFAULT)
+            lbl_default = label;
+        else
+            cases[ncases++] = (Case) { stmt->val, label };
+    }
 
-    bool lhs_is_ptr = lhs->type->ty == PTR || lhs->type->ty == ARRAY;
-    bool rhs_is_ptr = rhs->type->ty == PTR || rhs->type->ty == ARRAY;
-    if (lhs_is_ptr && rhs_is_ptr) {
-        fprintf(stderr, "Pointer +/- pointer operation not supported (yet).\n");
-        exit(1);
+    // Sort the cases by their values.
+    for (int i = 1; i < ncases; i++) {
+        Case c = cases[i];
+        int j = i;
+        for (; j > 0 && cases[j-1].val > c.val; j--)
+            cases[j] = cases[j-1];
+        cases[j] = c;
     }
 
-    // Integer type or pointer arithmatic.
-    gen(lhs, idents);
-    if (rhs_is_ptr) {
-        size_t ptrsize = get_typesize(rhs->type->ptr_of);
-        printf("  mov rdi, %zu\n", ptrsize);
-        printf("  mul rdi\n");
+    // A constant value goes to its label directly.
+    if (node->cond->ty == ND_NUM) {
+        int target = lbl_default;
+        for (int i = 0; i < ncases; i++)
+            if (cases[i].val == node->cond->val)
+                target = cases[i].label;
+        emit("  jmp .L%d\n", target);
+    } else {
+        gen(node->cond, idents);
+        Cluster *clusters = malloc(sizeof(Cluster) * (ncases + 1));
+        int nclusters = find_clusters(cases, ncases, clusters);
+        gen_cluster_tree(cases, clusters, nclusters, lbl_default);
     }
-    push("rax");
-    gen(rhs, idents);
-    if (lhs_is_ptr) {
-        size_t ptrsize = get_typesize(lhs->type->ptr_of);
-        printf("  mov rdi, %zu\n", ptrsize);
-        printf("  mul rdi\n");
+
+    Vector *outer_nodes = label_nodes;
+    Vector *outer_numbers = label_numbers;
+    int outer_break = break_label;
+    label_nodes = nodes;
+    label_numbers = numbers;
+    break_label = lbl_end;
+    gen(node->then, idents);
+    label_nodes = outer_nodes;
+    label_numbers = outer_numbers;
+    break_label = outer_break;
+    emit(".L%d:\n", lbl_end);
+}
+
+static void gen_label(const Node *node) {
+    for (int i = 0; i < label_nodes->len; i++) {
+        if (label_nodes->data[i] == node) {
+            int label = (int)(size_t)label_numbers->data[i];
+            if (label >= 0)
+                emit(".L%d:\n", label);
+            return;
+        }
     }
-    push("rax");
-    pop("rdi");
-    pop("rax");
+}
 
-    if (ty == '+')
-        printf("  add rax, rdi\n");
-    else 
-        printf("  sub rax, rdi\n");
+// Print the jump tables of the current function. An entry is the offset of
+// a label from the table, which needs no relocation in a position
+// independent executable.
+static void gen_jump_tables(void) {
+    if (jump_tables->len == 0)
+        return;
+    printf(".section .rodata\n");
+    for (int i = 0; i < jump_tables->len; i++) {
+        JumpTable *table = (JumpTable *)jump_tables->data[i];
+        printf(".align 4\n");
+        printf(".L%d:\n", table->label);
+        for (int j = 0; j < table->targets->len; j++)
+            printf("  .long .L%d-.L%d\n", (int)(size_t)table->targets->data[j], table->label);
+    }
+    printf(".text\n");
 }
 
 static void gen(const Node *node, const Map *idents) {
 #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
     switch (node->ty) {
     case ND_BLANK:
         return;
 
     case ND_DECLARATION:
-        if (node->declinit) {
-            gen_lval(node, idents);
-            push("rax");
-            gen(node->declinit, idents);
-            pop("rdi");
-            gen_typed_mov_rax_to_ptr_rdi(node->type);
+        if (node->zeroinit) {
+            Addr addr;
+            static_addr(node, idents, &addr);
+            gen_block_zero(&addr, get_typesize(node->type));
         }
+        if (node->declinit)
+            gen_assign(node, node->type, node->declinit, idents);
         return;
 
     case ND_NUM:
-        printf("  mov rax, %d\n", node->val);
+        // Writing to eax zero-extends. Only negative values need rax.
+        if (node->val >= 0)
+            emit("  mov eax, %d\n", node->val);
+        else
+            emit("  mov rax, %d\n", node->val);
         return;
 
     case ND_IDENT:
-        gen_lval(node, idents);
-        // If the identifier is an array, we take its address as its value.
+    case ND_MEMBER:
+    {
+        // If the lvalue is an array, we take its address as its value.
         // Otherwise, we take the value at its address.
-        if (node->type->ty != ARRAY) {
-            gen_typed_rax_dereference(node->type);
-        }
+        Addr addr;
+        gen_addr(node, idents, &addr);
+        gen_typed_load(node->type, &addr);
         return;
+    }
 
     case ND_STRING:
-        printf("  mov qword ptr [rsp-8], offset flat:.LC%d\n", (int)map_get(strings, node->name));
-        printf("  mov rax, qword ptr [rsp-8]\n");
-        return;
-
-    case ND_MEMBER:
-        gen_lval(node, idents);
-        gen_typed_rax_dereference(node->type);
+        emit("  lea rax, %s[rip]\n", (char *)map_get(strings, node->name));
         return;
 
     case ND_UEXPR:
@@ -322,29 +1966,21 @@ static void gen(const Node *node, const Map *idents) {
             // Prefix increment/decrement, on the other hand, are expressed as (E = E + 1).
 
             // First evaluate the value of the operand.
-            gen_lval(node->operand, idents);
-            printf("  mov rdi, rax\n");
-            gen_typed_rax_dereference(node->operand->type);
+            const Type *type = node->operand->type;
+            Addr addr;
+            if (!static_addr(node->operand, idents, &addr)) {
+                gen_lval(node->operand, idents);
+                emit("  mov rdi, rax\n");
+                addr = (Addr) { .base = "rdi" };
+            }
+            gen_typed_load(type, &addr);
             push("rax");
 
-            // Then increment/decrement.
-            push("rdi");
-            char operator = node->uop == TK_INCREMENT ? '+' : '-';
-            gen_add(
-                operator,
-                node->operand,
-                &(Node) {
-                    .ty = ND_NUM,
-                    .val = 1,
-                    .type = &(Type) {
-                        .ty = INT,
-                        .ptr_of = NULL,
-                        .array_len = 0
-                    }
-                },
-                idents);
-            pop("rdi");
-            gen_typed_mov_rax_to_ptr_rdi(node->type);
+            // Then increment/decrement. A pointer steps by the size of the
+            // pointed type.
+            int step = is_ptr_like(type) ? (int)get_typesize(type->ptr_of) : 1;
+            emit("  %s rax, %d\n", node->uop == TK_INCREMENT ? "add" : "sub", step);
+            gen_typed_store(type, &addr);
             pop("rax");
             break;
         }
@@ -353,9 +1989,12 @@ static void gen(const Node *node, const Map *idents) {
             gen_lval(node->operand, idents);
             break;
         case '*':
-            gen_lval(node, idents);
-            gen_typed_rax_dereference(node->type);
+        {
+            Addr addr;
+            gen_addr(node, idents, &addr);
+            gen_typed_load(node->type, &addr);
             break;
+        }
         case '+':
         case '-':
             gen_add(
@@ -382,47 +2021,8 @@ static void gen(const Node *node, const Map *idents) {
         return;
 
     case ND_CALL:
-    {
-        int nargs = node->fargs->len;
-        int nregargs = nargs <= 6 ? nargs : 6;
-        int nstackargs = nargs - nregargs;
-        char *regs[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
-
-        // Align stack pointer to 16 bytes.
-        int orig_stackpos = stackpos;
-        bool align_stack = (stackpos + 8 * nstackargs) % 16 != 0;
-        if (align_stack) {
-            printf("  sub rsp, 8\n");
-            stackpos += 8;
-        }
-
-        // Evaluate argument expressions.
-        for (int i = nargs - 1; i >= 0; i--) {
-            gen(node->fargs->data[i], idents);
-            push("rax");
-        }
-
-        // Assign first 6 args to registers. Leave the rest on the stack.
-        for (int i = 0; i < nregargs; i++)
-            pop(regs[i]);
-
-        printf("  xor rax, rax\n");
-        printf("  call %s\n", node->name);
-
-        // Remove stack-passed args.
-        if (nstackargs > 0) {
-            printf("  sub rsp, %d\n", 8 * nstackargs);
-            stackpos -= 8 * nstackargs;
-        }
-
-        if (align_stack) {
-            printf("  add rsp, 8\n");
-            stackpos -= 8;
-        }
-        assert(stackpos == orig_stackpos);
-
+        gen_call(node, idents);
         return;
-    }
 
     case ND_COMPOUND:
     {
@@ -440,73 +2040,126 @@ static void gen(const Node *node, const Map *idents) {
 
         gen(node->cond, idents);
         gen_typed_cmp_rax_to_0(node->cond->type);
-        printf("  je .L%d\n", lbl_else);
+        emit("  je .L%d\n", lbl_else);
 
         gen(node->then, idents);
-        printf("  jmp .L%d\n", lbl_last);
+        emit("  jmp .L%d\n", lbl_last);
 
-        printf(".L%d:\n", lbl_else);
+        emit(".L%d:\n", lbl_else);
         if (node->els != NULL) {
             gen(node->els, idents);
         }
-        printf(".L%d:\n", lbl_last);
+        emit(".L%d:\n", lbl_last);
         return;
     }
 
     case ND_WHILE:
     {
-        int lbl_beg = nlabel++;
+        // Rotated loop. The condition is tested once on entry and then at
+        // the bottom of the body, so that each iteration executes a single
+        // conditional branch.
+        int lbl_body = nlabel++;
         int lbl_end = nlabel++;
+        int outer_break = break_label;
 
-        printf(".L%d:\n", lbl_beg);
-        // Condition check.
-        gen(node->itercond, idents);
-        gen_typed_cmp_rax_to_0(node->itercond->type);
-        printf("  je .L%d\n", lbl_end);
+        gen_cond_jump(node->itercond, "je", lbl_end, idents);
 
+        emit("  .p2align 4\n");
+        emit(".L%d:\n", lbl_body);
+        break_label = lbl_end;
         gen(node->iterbody, idents);
+        break_label = outer_break;
 
-        printf("  jmp .L%d\n", lbl_beg);
-        printf(".L%d:\n", lbl_end);
+        gen_cond_jump(node->itercond, "jne", lbl_body, idents);
+        emit(".L%d:\n", lbl_end);
         return;
     }
 
     case ND_FOR:
     {
-        int lbl_beg = nlabel++;
+        // Rotated loop as well as a while-loop. An empty condition makes an
+        // infinite loop.
+        int lbl_body = nlabel++;
         int lbl_end = nlabel++;
+        bool has_cond = node->itercond->ty != ND_BLANK;
+        int outer_break = break_label;
 
         gen(node->iterinit, idents);
-        printf(".L%d:\n", lbl_beg);
-
-        gen(node->itercond, idents);
-        gen_typed_cmp_rax_to_0(node->itercond->type);
-        printf("  je .L%d\n", lbl_end);
+        if (has_cond)
+            gen_cond_jump(node->itercond, "je", lbl_end, idents);
 
+        emit("  .p2align 4\n");
+        emit(".L%d:\n", lbl_body);
+        break_label = lbl_end;
         gen(node->iterbody, idents);
-
+        break_label = outer_break;
         gen(node->step, idents);
-        printf("  jmp .L%d\n", lbl_beg);
-        printf(".L%d:\n", lbl_end);
+
+        if (has_cond)
+            gen_cond_jump(node->itercond, "jne", lbl_body, idents);
+        else
+            emit("  jmp .L%d\n", lbl_body);
+        emit(".L%d:\n", lbl_end);
         return;
     }
 
+    case ND_SWITCH:
+        gen_switch(node, idents);
+        return;
+
+    case ND_CASE:
+    case ND_DEFAULT:
+        gen_label(node);
+        return;
+
+    case ND_BREAK:
+        emit("  jmp .L%d\n", break_label);
+        return;
+
+    case ND_LABEL:
+        emit("%s:\n", node->name);
+        return;
+
+    case ND_LABELADDR:
+        emit("  lea rax, %s[rip]\n", node->name);
+        return;
+
+    case ND_GOTO:
+        // A computed goto jumps through a register, which lets each of the
+        // jumps be predicted on its own.
+        if (node->rhs->ty == ND_LABELADDR) {
+            emit("  jmp %s\n", node->rhs->name);
+            return;
+        }
+        gen(node->rhs, idents);
+        emit("  jmp rax\n");
+        return;
+
     case ND_RETURN:
-        if (node->rhs) {
+        if (node->rhs && node->rhs->ty == ND_CALL && is_tail_call(node->rhs)) {
+            gen_tail_call(node->rhs, idents);
+            return;
+        }
+        if (node->rhs && cur_func->type->ty == STRUCT) {
+            gen_struct_return(node->rhs, idents);
+        } else if (node->rhs) {
             gen(node->rhs, idents);
         }
-        printf("  mov rsp, rbp\n");
-        printf("  pop rbp\n");
-        printf("  ret\n");
+        gen_epilogue();
+        emit("  ret\n");
         return;
 
     case '=':
-        gen_lval(node->lhs, idents);
-        push("rax");
-        gen(node->rhs, idents);
+        gen_assign(node->lhs, node->lhs->type, node->rhs, idents);
+        return;
 
-        pop("rdi");
-        gen_typed_mov_rax_to_ptr_rdi(node->lhs->type);
+    case ND_VLOOP:
+        gen_vloop(node, idents);
+        return;
+
+    case ND_COMMA:
+        gen(node->lhs, idents);
+        gen(node->rhs, idents);
         return;
 
     case ND_LOGICAL:
@@ -518,31 +2171,31 @@ static void gen(const Node *node, const Map *idents) {
 
         if (node->lop == '|') {
             gen(node->llhs, idents);
-            printf("  cmp rax, 0\n");
-            printf("  jne .L%d\n", lbl_true);
+            emit("  cmp rax, 0\n");
+            emit("  jne .L%d\n", lbl_true);
             gen(node->lrhs, idents);
-            printf("  cmp rax, 0\n");
-            printf("  jne .L%d\n", lbl_true);
-            printf(".L%d:\n", lbl_false);
-            printf("  xor rax, rax\n");
-            printf("  jmp .L%d\n", lbl_end);
-            printf(".L%d:\n", lbl_true);
-            printf("  mov rax, 1\n");
-            printf(".L%d:\n", lbl_end);
+            emit("  cmp rax, 0\n");
+            emit("  jne .L%d\n", lbl_true);
+            emit(".L%d:\n", lbl_false);
+            emit("  xor rax, rax\n");
+            emit("  jmp .L%d\n", lbl_end);
+            emit(".L%d:\n", lbl_true);
+            emit("  mov rax, 1\n");
+            emit(".L%d:\n", lbl_end);
             return;
         } else {
             gen(node->llhs, idents);
-            printf("  cmp rax, 0\n");
-            printf("  je .L%d\n", lbl_false);
+            emit("  cmp rax, 0\n");
+            emit("  je .L%d\n", lbl_false);
             gen(node->lrhs, idents);
-            printf("  cmp rax, 0\n");
-            printf("  je .L%d\n", lbl_false);
-            printf(".L%d:\n", lbl_true);
-            printf("  mov rax, 1\n");
-            printf("  jmp .L%d\n", lbl_end);
-            printf(".L%d:\n", lbl_false);
-            printf("  xor rax, rax\n");
-            printf(".L%d:\n", lbl_end);
+            emit("  cmp rax, 0\n");
+            emit("  je .L%d\n", lbl_false);
+            emit(".L%d:\n", lbl_true);
+            emit("  mov rax, 1\n");
+            emit("  jmp .L%d\n", lbl_end);
+            emit(".L%d:\n", lbl_false);
+            emit("  xor rax, rax\n");
+            emit(".L%d:\n", lbl_end);
             return;
         }
     }
@@ -554,113 +2207,303 @@ static void gen(const Node *node, const Map *idents) {
     }
 
     // Binary operators.
-    gen(node->lhs, idents);
-    push("rax");
-    gen(node->rhs, idents);
-    push("rax");
+    gen_binop(node->ty, node->type, node->lhs, node->rhs, idents);
+}
 
-    pop("rdi");
-    pop("rax");
+// Generate the body of a function once to find how deep its pushes go. The
+// code is left in the buffer so that the caller can inspect it.
+static int dry_run(const Node *func, const Map *idents) {
+    int saved_nlabel = nlabel;
+    int saved_ntables = jump_tables->len;
+    stackpos = omit_frame_pointer ? 0 : 8;
+    max_stackpos = stackpos;
+    int base = stackpos;
+    gen(func->fbody, idents);
+    nlabel = saved_nlabel;
+    jump_tables->len = saved_ntables;
+    return max_stackpos - base;
+}
 
-    switch (node->ty) {
-    case '|':
-        printf("  or rax, rdi\n");
-        break;
-    case '^':
-        printf("  xor rax, rdi\n");
-        break;
-    case '&':
-        printf("  and rax, rdi\n");
-        break;
-    case '*':
-        printf("  mul rdi\n");
-        break;
-    case '/':
-        switch (get_typesize(node->type)) {
-        case 4:
-            printf("  cltd\n");
-            printf("  idiv edi\n");
-            break;
-        case 8:
-            printf("  cqto\n");
-            printf("  idiv rdi\n");
-            break;
-        default:
-            fprintf(stderr, "Division of a type with unsupported type size.\n");
-            exit(1);
+// Choose registers that keep parameters of a leaf function for its whole
+// body. A parameter stays in its incoming register unless the body uses the
+// register as a scratch, in which case it moves to a spare one. Parameters
+// that fit nowhere are copied to the stack as usual. The scratch registers
+// are found with all parameters on the stack; where the parameters live
+// does not change them.
+static Map *choose_resident_params(const Node *func) {
+    Map *resident = new_map();
+    int nargs = func->fargs->len;
+    int nregargs = nargs <= 6 ? nargs : 6;
+    Map *idents = new_map();
+    layout_frame(func, resident, idents);
+    dry_run(func, idents);
+
+    // Spare registers must not hold incoming parameters.
+    const char *spares[8] = { "r11", "r10" };
+    int nspares = 2;
+    for (int i = 5; i >= nregargs; i--)
+        spares[nspares++] = arg_regs[i];
+
+    for (int i = 0; i < nregargs; i++) {
+        Node *param = (Node *)func->fargs->data[i];
+        if (param->type->ty == STRUCT)
+            continue;
+        if (!emitted_clobbers(arg_regs[i])) {
+            map_put(resident, param->name, (void *)arg_regs[i]);
+            continue;
+        }
+        for (int j = 0; j < nspares; j++) {
+            if (spares[j] && !emitted_clobbers(spares[j])) {
+                map_put(resident, param->name, (void *)spares[j]);
+                spares[j] = NULL;
+                break;
+            }
         }
-        break;
-    case '<':
-        printf("  cmp eax, edi\n");
-        printf("  setl al\n");
-        printf("  movzb rax, al\n");
-        break;
-    case '>':
-        printf("  cmp eax, edi\n");
-        printf("  setg al\n");
-        printf("  movzb rax, al\n");
-        break;
-    case ND_LESSEQUAL:
-        printf("  cmp eax, edi\n");
-        printf("  setle al\n");
-        printf("  movzb rax, al\n");
-        break;
-    case ND_GREATEREQUAL:
-        printf("  cmp eax, edi\n");
-        printf("  setge al\n");
-        printf("  movzb rax, al\n");
-        break;
-    case ND_EQUAL:
-        printf("  cmp eax, edi\n");
-        printf("  sete al\n");
-        printf("  movzb rax, al\n");
-        break;
-    case ND_NOTEQUAL:
-        printf("  cmp eax, edi\n");
-        printf("  setne al\n");
-        printf("  movzb rax, al\n");
-        break;
-    default:
-        fprintf(stderr, "An unexpected operator type %d during assembly generation.\n",
-                node->ty);
-        exit(1);
     }
+    emit_discard();
+    return resident;
 }
 
 void gen_function(Node *func) {
-    stackpos = 0;
-    printf("%s:\n", func->fname);
-    push("rbp");
-    printf("  mov rbp, rsp\n");
-
-    // Count number of used identifiers (including function parameters) and
-    // allocate stack for local variables. If an identifier gets redefined,
-    // it may count it twice or more but it's ok.
+    cur_func = func;
+    jump_tables = new_vector();
+    frame_reusable = !frame_escapes(func);
+    red_zone_shift = 0;
+    out_base = -1;
+
+    // Parameters of a leaf function may stay in registers unless their
+    // addresses are taken.
+    bool leaf = is_leaf_function(func);
+    Map *resident = leaf && frame_reusable && has_simple_params(func)
+        ? choose_resident_params(func) : new_map();
+
+    // Assign stack slots to parameters and local variables.
     Map *idents = new_map();
-    int stack_offset = idents_in_func(func, idents);
-    assert(stack_offset <= 0);
-    printf("  sub rsp, %d\n", -stack_offset);
-    stackpos += -stack_offset;
+    int frame_size = layout_frame(func, resident, idents);
+
+    // A leaf function keeps its locals in the 128-byte red zone below the
+    // stack pointer, beneath the space used by its pushes. Without a frame
+    // pointer and locals, it has no frame at all.
+    if (leaf && frame_size <= 128) {
+        int depth = dry_run(func, idents);
+        emit_discard();
+        depth = (depth + frame_align - 1) & ~(frame_align - 1);
+        if (depth + frame_size <= 128) {
+            red_zone_shift = depth;
+            frame_size = 0;
+        }
+    }
+
+    // Reserve the outgoing argument area below the locals, padded so that
+    // the stack pointer is aligned to 16 bytes at calls.
+    int out_size = 0;
+    if (!leaf) {
+        Vector *calls = new_vector();
+        find_calls(func->fbody, calls);
+        for (int i = 0; i < calls->len; i++) {
+            Node *call = (Node *)calls->data[i];
+            ArgLoc *locs = malloc(sizeof(ArgLoc) * (call->fargs->len + 1));
+            int size = classify_args(call->fargs, is_memory_class(call->type), locs);
+            free(locs);
+            if (size > out_size)
+                out_size = size;
+        }
+        if (((omit_frame_pointer ? 0 : 8) + frame_size + out_size) % 16 != 8)
+            out_size += 8;
+    }
+
+    stackpos = 0;
+    emit("%s:\n", func->fname);
+    if (!omit_frame_pointer) {
+        push("rbp");
+        emit("  mov rbp, rsp\n");
+    }
+    if (frame_size + out_size > 0) {
+        emit("  sub rsp, %d\n", frame_size + out_size);
+        stackpos += frame_size + out_size;
+    }
+    if (!leaf)
+        out_base = stackpos;
 
-    // First 6 function parameters are in registers. Copy them to stack.
-    const char *regs[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+    // Parameters in registers are copied to stack or to the registers
+    // chosen to keep them.
     int nargs = func->fargs->len;
-    int nregargs = nargs <= 6 ? nargs : 6;
-    for (int i = 0; i < nregargs; i++) {
+    ArgLoc *locs = malloc(sizeof(ArgLoc) * (nargs + 1));
+    classify_args(func->fargs, is_memory_class(func->type), locs);
+    if (is_memory_class(func->type)) {
+        Addr addr = frame_slot((int)((Ident *)map_get(idents, ".sret"))->offset);
+        emit("  mov qword ptr %s, rdi\n", addr_operand(&addr));
+    }
+    for (int i = 0; i < nargs; i++) {
         char *param_name = ((Node *)func->fargs->data[i])->name;
         Ident *ident = (Ident *)map_get(idents, param_name);
-        printf("  mov [rbp+%zu], %s\n", ident->offset, regs[i]);
+        if (locs[i].reg < 0 || ident->reg)
+            continue;
+        Addr addr = frame_slot((int)ident->offset);
+        size_t siz = get_typesize(ident->type);
+        if (ident->type->ty == STRUCT) {
+            for (int off = 0; off < (int)siz; off += 8) {
+                Addr to = addr;
+                to.disp += off;
+                emit("  mov qword ptr %s, %s\n",
+                        addr_operand(&to), arg_regs[locs[i].reg + off / 8]);
+            }
+            continue;
+        }
+        emit("  mov %s %s, %s\n", ptr_size_name(siz), addr_operand(&addr),
+                sized_reg(arg_regs[locs[i].reg], siz));
+    }
+    for (int i = 0; i < nargs; i++) {
+        char *param_name = ((Node *)func->fargs->data[i])->name;
+        Ident *ident = (Ident *)map_get(idents, param_name);
+        if (ident->reg && strcmp(ident->reg, arg_regs[i]) != 0)
+            emit("  mov %s, %s\n", ident->reg, arg_regs[i]);
     }
+    lbl_start = nlabel++;
+    emit(".L%d:\n", lbl_start);
 
     // Generate assembly from the ASTs.
     gen(func->fbody, idents);
 
-    // End of function. Return default int.
-    // This will likely emit a redundant function epilogue after a return statement.
-    // It is at least functionally ok since this will not be executed.
-    printf("  xor rax, rax\n");
-    printf("  mov rsp, rbp\n");
-    printf("  pop rbp\n");
-    printf("  ret\n");
+    // End of function. Return default int unless the body never reaches here.
+    if (falls_through(func->fbody)) {
+        emit("  xor rax, rax\n");
+        gen_epilogue();
+        emit("  ret\n");
+    }
+    emit_flush();
+    gen_jump_tables();
+}
+
+// =============================================================================
+// Static data.
+//
+// A global variable with an initializer is emitted into .data, or .rodata if
+// it is const, as its elements in order with the gaps between them zeroed.
+// A const one without an initializer is zeroed in .rodata, and others in
+// .bss, sorted by alignment and size so that no padding is left between
+// them. Images of local initializers, whose names are local labels, are not
+// exported.
+// =============================================================================
+static void gen_data_value(const Type *type, const Node *value) {
+    char *sym;
+    int val;
+    if (!eval_const(value, &sym, &val)) {
+        fprintf(stderr, "A static initializer not constant.\n");
+        exit(1);
+    }
+    switch (get_typesize(type)) {
+    case 1:
+        printf("  .byte %d\n", val & 0xff);
+        return;
+    case 2:
+        printf("  .short %d\n", val & 0xffff);
+        return;
+    case 4:
+        printf("  .long %d\n", val);
+        return;
+    default:
+        if (!sym)
+            printf("  .quad %d\n", val);
+        else if (val)
+            printf("  .quad %s%+d\n", sym, val);
+        else
+            printf("  .quad %s\n", sym);
+        return;
+    }
+}
+
+// Alignment of a global variable. Arrays of 16 bytes or more are aligned to
+// 16 bytes as the ABI requires, and those of a cache line or more to 64 bytes
+// so that vector loads and cache lines over them line up.
+static size_t get_dataalign(const Type *type) {
+    size_t align = get_typealign(type);
+    size_t size = get_typesize(type);
+    if (type->ty == ARRAY && size >= 64 && align < 64)
+        return 64;
+    if (type->ty == ARRAY && size >= 16 && align < 16)
+        return 16;
+    return align;
 }
 
+static bool is_bss(const Node *var) {
+    return !var->declinit && !var->inits && !is_readonly(var->type);
+}
+
+// Return true if the initial value of a variable has addresses, which need
+// relocations when the program is loaded at a position chosen at run time.
+static bool has_relocs(const Node *var) {
+    char *sym;
+    int val;
+    if (var->declinit)
+        return eval_const(var->declinit, &sym, &val) && sym;
+    for (int i = 0; var->inits && i < var->inits->len; i++) {
+        const Init *init = (Init *)var->inits->data[i];
+        if (eval_const(init->value, &sym, &val) && sym)
+            return true;
+    }
+    return false;
+}
+
+static void gen_global(const char *name, const Node *var) {
+    size_t size = get_typesize(var->type);
+    if (is_bss(var))
+        printf(".bss\n");
+    else if (is_readonly(var->type) && has_relocs(var))
+        printf(".section .data.rel.ro,\"aw\"\n");
+    else if (is_readonly(var->type))
+        printf(".section .rodata\n");
+    else
+        printf(".data\n");
+    printf(".align %zu\n", get_dataalign(var->type));
+    if (strncmp(name, ".L", 2) != 0)
+        printf(".global %s\n", name);
+    printf("%s:\n", name);
+
+    if (var->declinit) {
+        gen_data_value(var->type, var->declinit);
+        return;
+    }
+    size_t offset = 0;
+    for (int i = 0; var->inits && i < var->inits->len; i++) {
+        const Init *init = (Init *)var->inits->data[i];
+        if (init->offset > offset)
+            printf("  .zero %zu\n", init->offset - offset);
+        gen_data_value(init->type, init->value);
+        offset = init->offset + get_typesize(init->type);
+    }
+    if (size > offset)
+        printf("  .zero %zu\n", size - offset);
+}
+
+void gen_globals(const Map *vars) {
+    Vector *bss = new_vector();
+    for (int i = 0; i < vars->keys->len; i++) {
+        const Node *var = (Node *)vars->vals->data[i];
+        if (is_bss(var))
+            vec_push(bss, (void *)(size_t)i);
+        else
+            gen_global((char *)vars->keys->data[i], var);
+    }
+
+    // Insertion sort keeps the order of the declarations among those of the
+    // same alignment and size.
+    for (int i = 1; i < bss->len; i++) {
+        const void *k = bss->data[i];
+        const Type *type = ((Node *)vars->vals->data[(size_t)k])->type;
+        int j = i;
+        for (; j > 0; j--) {
+            const Type *other = ((Node *)vars->vals->data[(size_t)bss->data[j-1]])->type;
+            if (get_dataalign(other) > get_dataalign(type)
+                    || (get_dataalign(other) == get_dataalign(type)
+                        && get_typesize(other) >= get_typesize(type)))
+                break;
+            bss->data[j] = bss->data[j-1];
+        }
+        bss->data[j] = k;
+    }
+    for (int i = 0; i < bss->len; i++) {
+        size_t k = (size_t)bss->data[i];
+        gen_global((char *)vars->keys->data[k], (Node *)vars->vals->data[k]);
+    }
+}
@@ -29,21 +29,81 @@ char *read_file(char *path) {
     return buf;
 }
 
+// Compiler options.
+bool opt_remarks = false;
+int unroll_factor = 0;
+bool use_avx2 = false;
+int inline_limit = 40;
+int block_inline_limit = 256;
+bool omit_frame_pointer = false;
+
 int main(int argc, char **argv) {
 #pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
-    if (argc != 2) {
+    char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        // Test.
+        if (strcmp(argv[i], "-test") == 0) {
+            runtest_util();
+            runtest_type();
+            runtest_peephole();
+            return 0;
+        }
+
+        if (strcmp(argv[i], "-Rpass") == 0) {
+            opt_remarks = true;
+            continue;
+        }
+        if (strcmp(argv[i], "-fomit-frame-pointer") == 0) {
+            omit_frame_pointer = true;
+            continue;
+        }
+        if (strcmp(argv[i], "-mavx2") == 0) {
+            use_avx2 = true;
+            continue;
+        }
+        if (strncmp(argv[i], "-funroll-loops=", 15) == 0) {
+            char *end;
+            unroll_factor = strtol(argv[i] + 15, &end, 10);
+            if (end == argv[i] + 15 || *end || unroll_factor < 1) {
+                fprintf(stderr, "Invalid unroll factor in %s.\n", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        if (strncmp(argv[i], "-finline-limit=", 15) == 0) {
+            char *end;
+            inline_limit = strtol(argv[i] + 15, &end, 10);
+            if (end == argv[i] + 15 || *end || inline_limit < 0) {
+                fprintf(stderr, "Invalid inline limit in %s.\n", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        if (strncmp(argv[i], "-fblock-inline-limit=", 21) == 0) {
+            char *end;
+            block_inline_limit = strtol(argv[i] + 21, &end, 10);
+            if (end == argv[i] + 21 || *end || block_inline_limit < 0) {
+                fprintf(stderr, "Invalid block inline limit in %s.\n", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        if (argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option %s.\n", argv[i]);
+            return 1;
+        }
+        if (path) {
+            fprintf(stderr, "Invalid number of arguments.\n");
+            return 1;
+        }
+        path = argv[i];
+    }
+    if (!path) {
         fprintf(stderr, "Invalid number of arguments.\n");
         return 1;
     }
 
-    // Test.
-    if (strcmp(argv[1], "-test") == 0) {
-        runtest_util();
-        runtest_type();
-        return 0;
-    }
-    
-    char *src = read_file(argv[1]);
+    char *src = read_file(path);
 
     // Tokenize and parse to abstract syntax tree.
     tokenize(src);
@@ -53,39 +113,28 @@ int main(int argc, char **argv) {
     printf(".global main\n");
 
     // Global variables.
-    for (int i = 0; i < globalvars->keys->len; i++) {
-        char *name = (char *)globalvars->keys->data[i];
-        Node *var = (Node *)globalvars->vals->data[i];
-        Type *type = var->type;
-        size_t siz = get_typesize(type);
-        if (var->declinit) {
-            assert(var->declinit->ty == ND_NUM);
-            assert(var->declinit->type->ty == INT);
-            printf(".data\n");
-            printf(".global %s\n", name);
-            printf("%s:\n", name);
-            printf("  .long %d\n", var->declinit->val);
-        }
-        else {
-            printf(".bss\n");
-            printf(".global %s\n", name);
-            printf("%s:\n", name);
-            printf("  .zero %zu\n", siz);
-        }
-    }
+    gen_globals(globalvars);
 
-    // String literals.
-    printf(".section .rodata\n");
+    // String literals, which the linker may merge with equal ones and
+    // suffixes of longer ones in other objects.
+    printf(".section .rodata.str1.1,\"aMS\",@progbits,1\n");
     for (int i = 0; i < strings->keys->len; i++) {
-        printf(".LC%d:\n", (int)strings->vals->data[i]);
+        printf("%s:\n", (char *)strings->vals->data[i]);
         printf("  .string \"%s\"\n", (char *)strings->keys->data[i]);
     }
 
     printf(".text\n");
+    inline_functions(funcdefs);
     for (int i = 0; i < funcdefs->len; i++) {
         Node *func = (Node *)funcdefs->data[i];
+        optimize(func);
         gen_function(func);
         ++func;
     }
+
+    if (opt_remarks) {
+        opt_report();
+        peephole_report();
+    }
     return 0;
 }
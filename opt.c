@@ -0,0 +1,3079 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "cc.h"
+
+// =============================================================================
+// Optimization on abstract syntax trees.
+//
+// A local variable whose address is never taken can only be changed by the
+// assignments in its function. Its values are followed through structured
+// control flow, which plays the role that SSA form plays in a compiler with
+// a lower-level representation:
+// - Sparse conditional constant propagation. Constants and copies of such
+//   variables are propagated, expressions are folded, and only the branches
+//   that can be taken under the propagated values are visited.
+// - Dead code elimination. Unreachable statements, unused values without
+//   side effects, and stores to variables that are never read are removed.
+// =============================================================================
+
+// Statistics reported with -Rpass.
+enum {
+    ST_FOLDED,
+    ST_CONSTANTS,
+    ST_COPIES,
+    ST_BRANCHES,
+    ST_UNREACHABLE,
+    ST_DEAD_STORES,
+    ST_DEAD_EXPRS,
+    ST_DEAD_VARS,
+    ST_CSE,
+    ST_HOISTED,
+    ST_DERIVED,
+    ST_REMOVED_IVS,
+    ST_UNROLLED,
+    ST_FULLY_UNROLLED,
+    ST_VECTORIZED,
+    ST_INLINED,
+    NSTATS,
+};
+
+static const char *stat_names[NSTATS] = {
+    "folded-expressions",
+    "propagated-constants",
+    "propagated-copies",
+    "folded-branches",
+    "unreachable-statements",
+    "dead-stores",
+    "dead-expressions",
+    "dead-variables",
+    "common-subexpressions",
+    "hoisted-invariants",
+    "strength-reduced-addresses",
+    "removed-induction-variables",
+    "unrolled-loops",
+    "fully-unrolled-loops",
+    "vectorized-loops",
+    "inlined-calls",
+};
+
+static int stats[NSTATS];
+
+// Local variables followed by the optimizer.
+static Vector *vars;        // Names.
+static Vector *var_types;   // Types.
+
+static int var_index_of(const char *name) {
+    for (int i = 0; i < vars->len; i++)
+        if (strcmp((const char *)vars->data[i], name) == 0)
+            return i;
+    return -1;
+}
+
+static int var_index(const Node *node) {
+    if (node->ty != ND_IDENT)
+        return -1;
+    return var_index_of(node->name);
+}
+
+static const Type *var_type(int x) {
+    return (const Type *)var_types->data[x];
+}
+
+// Parameters and local variables whose addresses are never taken, including
+// arrays and pointers. Only assignments to them change their values.
+static Vector *locals;
+
+static bool contains_name(const Vector *names, const char *name) {
+    for (int i = 0; i < names->len; i++)
+        if (strcmp((const char *)names->data[i], name) == 0)
+            return true;
+    return false;
+}
+
+static bool is_local(const Node *node) {
+    return node->ty == ND_IDENT && contains_name(locals, node->name);
+}
+
+// Arrays and structs local to the function whose addresses never escape.
+static Vector *objects;
+
+// Function being optimized and the number of temporary variables in it.
+static Node *cur_func;
+static int ntemps;
+static Vector *temp_decls;
+
+// =============================================================================
+// Traversal of nodes.
+// =============================================================================
+// List the addresses of the child node pointers, so that a pass can visit
+// and replace children without knowing each node type.
+static Vector *children(Node *node) {
+    Vector *slots = new_vector();
+    switch (node->ty) {
+    case ND_BLANK:
+    case ND_NUM:
+    case ND_IDENT:
+    case ND_STRING:
+    case ND_CASE:
+    case ND_DEFAULT:
+    case ND_BREAK:
+    case ND_LABEL:
+    case ND_LABELADDR:
+        break;
+    case ND_DECLARATION:
+        vec_push(slots, &node->declinit);
+        break;
+    case ND_MEMBER:
+        vec_push(slots, &node->member_of);
+        break;
+    case ND_UEXPR:
+        vec_push(slots, &node->operand);
+        break;
+    case ND_LOGICAL:
+        vec_push(slots, &node->llhs);
+        vec_push(slots, &node->lrhs);
+        break;
+    case ND_CALL:
+        for (int i = 0; i < node->fargs->len; i++)
+            vec_push(slots, &node->fargs->data[i]);
+        break;
+    case ND_COMPOUND:
+        for (int i = 0; i < node->stmts->len; i++)
+            vec_push(slots, &node->stmts->data[i]);
+        break;
+    case ND_IF:
+    case ND_SWITCH:
+        vec_push(slots, &node->cond);
+        vec_push(slots, &node->then);
+        vec_push(slots, &node->els);
+        break;
+    case ND_WHILE:
+    case ND_FOR:
+        vec_push(slots, &node->iterinit);
+        vec_push(slots, &node->itercond);
+        vec_push(slots, &node->iterbody);
+        vec_push(slots, &node->step);
+        break;
+    case ND_VLOOP:
+        vec_push(slots, &node->vindex);
+        vec_push(slots, &node->vlimit);
+        vec_push(slots, &node->vstmt);
+        break;
+    default:
+        // Binary operators, and return and goto statements.
+        vec_push(slots, &node->lhs);
+        vec_push(slots, &node->rhs);
+        break;
+    }
+
+    // Drop empty slots, e.g., an if-statement without else.
+    Vector *nonnull = new_vector();
+    for (int i = 0; i < slots->len; i++)
+        if (*(Node **)slots->data[i])
+            vec_push(nonnull, slots->data[i]);
+    return nonnull;
+}
+
+static Vector *copy_vector(const Vector *v) {
+    Vector *copy = new_vector();
+    for (int i = 0; i < v->len; i++)
+        vec_push(copy, v->data[i]);
+    return copy;
+}
+
+// Deep copy of a tree. The parser shares subtrees, e.g., the lhs of "x += 1"
+// appears on both sides of (x = x + 1). Passes replace children of a node and
+// need each node to appear once.
+static Node *clone(const Node *node) {
+    Node *copy = malloc(sizeof(Node));
+    *copy = *node;
+    if (node->ty == ND_CALL)
+        copy->fargs = copy_vector(node->fargs);
+    else if (node->ty == ND_COMPOUND)
+        copy->stmts = copy_vector(node->stmts);
+
+    Vector *slots = children(copy);
+    for (int i = 0; i < slots->len; i++) {
+        Node **slot = (Node **)slots->data[i];
+        *slot = clone(*slot);
+    }
+    return copy;
+}
+
+// Return true if a statement has a label or a goto statement.
+bool has_goto(const Node *node) {
+    if (node->ty == ND_LABEL || node->ty == ND_GOTO)
+        return true;
+    Vector *slots = children((Node *)node);
+    for (int i = 0; i < slots->len; i++)
+        if (has_goto(*(Node **)slots->data[i]))
+            return true;
+    return false;
+}
+
+static bool has_side_effects(Node *node) {
+    if (node->ty == '=' || node->ty == ND_CALL)
+        return true;
+    if (node->ty == ND_UEXPR
+            && (node->uop == TK_INCREMENT || node->uop == TK_DECREMENT))
+        return true;
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        if (has_side_effects(*(Node **)slots->data[i]))
+            return true;
+    return false;
+}
+
+static Node *new_compound(void) {
+    Node *node = new_node(ND_COMPOUND);
+    node->stmts = new_vector();
+    return node;
+}
+
+// Return true if a statement has a break statement leaving the loop or the
+// switch statement it is in, i.e., one not in a nested loop or switch.
+static bool breaks_out(const Node *stmt) {
+    switch (stmt->ty) {
+    case ND_BREAK:
+        return true;
+    case ND_COMPOUND:
+        for (int i = 0; i < stmt->stmts->len; i++)
+            if (breaks_out(stmt->stmts->data[i]))
+                return true;
+        return false;
+    case ND_IF:
+        return breaks_out(stmt->then) || (stmt->els && breaks_out(stmt->els));
+    default:
+        return false;
+    }
+}
+
+// Return true if control may reach the end of a statement. A statement with
+// a label may be entered by a goto anywhere, so it is assumed to.
+bool falls_through(const Node *stmt) {
+    if (has_goto(stmt))
+        return true;
+    switch (stmt->ty) {
+    case ND_RETURN:
+    case ND_BREAK:
+        return false;
+    case ND_COMPOUND:
+        for (int i = 0; i < stmt->stmts->len; i++)
+            if (!falls_through(stmt->stmts->data[i]))
+                return false;
+        return true;
+    case ND_IF:
+        return !stmt->els || falls_through(stmt->then) || falls_through(stmt->els);
+    case ND_WHILE:
+        if (breaks_out(stmt->iterbody))
+            return true;
+        return stmt->itercond->ty != ND_NUM || stmt->itercond->val == 0;
+    case ND_FOR:
+        if (breaks_out(stmt->iterbody))
+            return true;
+        if (stmt->itercond->ty == ND_BLANK)
+            return false;
+        return stmt->itercond->ty != ND_NUM || stmt->itercond->val == 0;
+    default:
+        return true;
+    }
+}
+
+// Return true if the address of an lvalue is known without any computation.
+// This follows what the code generator can use as a memory operand as is.
+static bool is_static_lval(const Node *node) {
+    switch (node->ty) {
+    case ND_IDENT:
+        return true;
+    case ND_MEMBER:
+        return is_static_lval(node->member_of);
+    case ND_UEXPR:
+    {
+        if (node->uop != '*')
+            return false;
+        const Node *ptr = node->operand;
+        if (ptr->type->ty == ARRAY && (ptr->ty == ND_IDENT || ptr->ty == ND_MEMBER))
+            return is_static_lval(ptr);
+        if ((ptr->ty == '+' || ptr->ty == '-') && ptr->lhs->type->ty == ARRAY
+                && ptr->rhs->ty == ND_NUM)
+            return is_static_lval(ptr->lhs);
+        return false;
+    }
+    default:
+        return false;
+    }
+}
+
+// =============================================================================
+// Temporary variables.
+// =============================================================================
+static Type *ptr_to(Type *type) {
+    Type *ptr = calloc(1, sizeof(Type));
+    ptr->ty = PTR;
+    ptr->ptr_of = type;
+    return ptr;
+}
+
+static Node *new_ident(const char *name, Type *type) {
+    Node *node = new_node(ND_IDENT);
+    node->name = (char *)name;
+    node->type = type;
+    return node;
+}
+
+// Make a new variable and return a reference to it. Names of temporaries
+// cannot collide with identifiers. The declarations are added to the function
+// body by declare_temps() after a pass.
+static Node *new_temp(Type *type) {
+    char *name = malloc(16);
+    sprintf(name, ".t%d", ntemps++);
+    Node *decl = new_node(ND_DECLARATION);
+    decl->name = name;
+    decl->type = type;
+    vec_push(temp_decls, decl);
+    vec_push(locals, name);
+    return new_ident(name, type);
+}
+
+static void declare_temps(void) {
+    Vector *stmts = temp_decls;
+    Vector *body = cur_func->fbody->stmts;
+    for (int i = 0; i < body->len; i++)
+        vec_push(stmts, body->data[i]);
+    cur_func->fbody->stmts = stmts;
+    temp_decls = new_vector();
+}
+
+static Node *new_comma(Node *lhs, Node *rhs) {
+    Node *node = new_node(ND_COMMA);
+    node->lhs = lhs;
+    node->rhs = rhs;
+    node->type = rhs->type;
+    return node;
+}
+
+static bool is_arith_operator(int ty) {
+    return ty == '+' || ty == '-' || ty == '*' || ty == '/' || ty == '%'
+        || ty == '&' || ty == '|' || ty == '^';
+}
+
+// The parser expresses "E op= V" and "++E" as (E = E op V) with E shared by
+// both sides, which evaluates E twice. Unless E is a variable or has a static
+// address, take the address once: (t = &E, *t = *t op V).
+static void lower_compound_assign(Node **p) {
+    Node *node = *p;
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        lower_compound_assign((Node **)slots->data[i]);
+
+    if (node->ty != '=' || !is_arith_operator(node->rhs->ty)
+            || node->rhs->lhs != node->lhs || is_static_lval(node->lhs))
+        return;
+
+    Node *lval = node->lhs;
+    Node *t = new_temp(ptr_to(lval->type));
+    Node *set = new_node_binop('=', t, new_node_uop('&', lval));
+    Node *op = new_node(node->rhs->ty);
+    *op = *node->rhs;
+    op->lhs = new_node_uop('*', new_ident(t->name, t->type));
+    node->lhs = new_node_uop('*', new_ident(t->name, t->type));
+    node->rhs = op;
+
+    *p = new_comma(set, node);
+}
+
+// =============================================================================
+// Sparse conditional constant propagation.
+// =============================================================================
+// Value of an expression or a variable.
+typedef struct {
+    enum { VAL_UNKNOWN, VAL_CONST, VAL_COPY } kind;
+    int val;    // Constant value, or the index of the copied variable.
+} Value;
+
+static const Value unknown = { VAL_UNKNOWN, 0 };
+
+static Value const_value(int val) {
+    return (Value) { VAL_CONST, val };
+}
+
+static bool same_value(Value v0, Value v1) {
+    return v0.kind == v1.kind && (v0.kind == VAL_UNKNOWN || v0.val == v1.val);
+}
+
+// Values of the variables at a point of a function.
+typedef struct {
+    bool unreachable;
+    Value *vals;
+} Env;
+
+static Env *new_env(void) {
+    Env *env = calloc(1, sizeof(Env));
+    env->vals = calloc(vars->len + 1, sizeof(Value));
+    return env;
+}
+
+static Env *copy_env(const Env *env) {
+    Env *copy = new_env();
+    copy->unreachable = env->unreachable;
+    memcpy(copy->vals, env->vals, vars->len * sizeof(Value));
+    return copy;
+}
+
+// Merge values at a join point of control flow. Return true if env changed.
+static bool meet_env(Env *env, const Env *other) {
+    if (other->unreachable)
+        return false;
+    if (env->unreachable) {
+        env->unreachable = false;
+        memcpy(env->vals, other->vals, vars->len * sizeof(Value));
+        return true;
+    }
+    bool changed = false;
+    for (int i = 0; i < vars->len; i++) {
+        if (!same_value(env->vals[i], other->vals[i])) {
+            changed |= env->vals[i].kind != VAL_UNKNOWN;
+            env->vals[i] = unknown;
+        }
+    }
+    return changed;
+}
+
+// Truncate a value stored to a variable. Narrow types are loaded with zero
+// extension.
+static int truncate_to(const Type *type, int val) {
+    switch (type->ty) {
+    case CHAR:
+        return (unsigned char)val;
+    case SHORT:
+        return (unsigned short)val;
+    default:
+        return val;
+    }
+}
+
+// Assign a value to a variable. The copies of the old value are invalidated.
+static Value assign_var(Env *env, int x, Value v) {
+    if (v.kind == VAL_CONST)
+        v.val = truncate_to(var_type(x), v.val);
+    if (v.kind == VAL_COPY && (v.val == x || var_type(v.val)->ty != var_type(x)->ty))
+        v = unknown;
+    for (int i = 0; i < vars->len; i++)
+        if (env->vals[i].kind == VAL_COPY && env->vals[i].val == x)
+            env->vals[i] = unknown;
+    env->vals[x] = v;
+    return v;
+}
+
+static bool fold_binop(int ty, int l, int r, int *result) {
+    unsigned ul = (unsigned)l;
+    unsigned ur = (unsigned)r;
+    switch (ty) {
+    case '+': *result = (int)(ul + ur); return true;
+    case '-': *result = (int)(ul - ur); return true;
+    case '*': *result = (int)(ul * ur); return true;
+    case '/':
+    case '%':
+        // Leave traps to run time.
+        if (r == 0 || (l == INT_MIN && r == -1))
+            return false;
+        *result = ty == '/' ? l / r : l % r;
+        return true;
+    case '&': *result = l & r; return true;
+    case '|': *result = l | r; return true;
+    case '^': *result = l ^ r; return true;
+    case '<': *result = l < r; return true;
+    case '>': *result = l > r; return true;
+    case ND_LESSEQUAL: *result = l <= r; return true;
+    case ND_GREATEREQUAL: *result = l >= r; return true;
+    case ND_EQUAL: *result = l == r; return true;
+    case ND_NOTEQUAL: *result = l != r; return true;
+    default:
+        return false;
+    }
+}
+
+// If a binary operation has an operand which does not change the other one,
+// e.g., x + 0 or x * 1, return the other one.
+static Node *identity_operand(const Node *node, Value l, Value r) {
+    Node *keep = NULL;
+    if (r.kind == VAL_CONST) {
+        switch (node->ty) {
+        case '+': case '-': case '|': case '^':
+            if (r.val == 0) keep = node->lhs;
+            break;
+        case '*': case '/':
+            if (r.val == 1) keep = node->lhs;
+            break;
+        }
+    }
+    if (!keep && l.kind == VAL_CONST) {
+        switch (node->ty) {
+        case '+': case '|': case '^':
+            if (l.val == 0) keep = node->rhs;
+            break;
+        case '*':
+            if (l.val == 1) keep = node->rhs;
+            break;
+        }
+    }
+    if (keep && keep->type && is_basic_type(keep->type))
+        return keep;
+    return NULL;
+}
+
+static Value eval(Node **p, Env *env, bool rewrite);
+
+// Visit subexpressions of an lvalue without reading the lvalue itself.
+static void eval_lval(Node **p, Env *env, bool rewrite) {
+    Node *node = *p;
+    switch (node->ty) {
+    case ND_IDENT:
+        return;
+    case ND_MEMBER:
+        eval_lval(&node->member_of, env, rewrite);
+        return;
+    case ND_UEXPR:
+        if (node->uop == '*') {
+            eval(&node->operand, env, rewrite);
+            return;
+        }
+        break;
+    }
+    eval(p, env, rewrite);
+}
+
+static Value eval_binop(Node **p, Env *env, bool rewrite) {
+    Node *node = *p;
+    Value l = eval(&node->lhs, env, rewrite);
+    Value r = eval(&node->rhs, env, rewrite);
+
+    // Pointer arithmetic is not folded.
+    if (!node->type || !is_basic_type(node->type))
+        return unknown;
+
+    int result;
+    if (l.kind == VAL_CONST && r.kind == VAL_CONST
+            && fold_binop(node->ty, l.val, r.val, &result))
+        return const_value(result);
+
+    // An operand absorbing the other one.
+    if ((node->ty == '*' || node->ty == '&')
+            && ((l.kind == VAL_CONST && l.val == 0) || (r.kind == VAL_CONST && r.val == 0)))
+        return const_value(0);
+
+    if (rewrite) {
+        Node *keep = identity_operand(node, l, r);
+        if (keep) {
+            *p = keep;
+            stats[ST_FOLDED]++;
+            return keep == node->lhs ? l : r;
+        }
+    }
+    return unknown;
+}
+
+static Value eval_logical(Node **p, Env *env, bool rewrite) {
+    Node *node = *p;
+    bool is_or = node->lop == '|';
+    Value l = eval(&node->llhs, env, rewrite);
+    if (l.kind == VAL_CONST) {
+        // The rhs is never evaluated if the lhs decides the result.
+        if (is_or == (l.val != 0))
+            return const_value(is_or);
+        Value r = eval(&node->lrhs, env, rewrite);
+        if (r.kind == VAL_CONST)
+            return const_value(r.val != 0);
+        if (rewrite && !has_side_effects(node->llhs)) {
+            *p = new_node_binop(ND_NOTEQUAL, node->lrhs, new_node_num(0));
+            stats[ST_FOLDED]++;
+        }
+        return unknown;
+    }
+
+    Env *rhs_env = copy_env(env);
+    Value r = eval(&node->lrhs, rhs_env, rewrite);
+    meet_env(env, rhs_env);
+    if (r.kind == VAL_CONST && is_or == (r.val != 0))
+        return const_value(is_or);
+    return unknown;
+}
+
+static Value eval_uexpr(Node **p, Env *env, bool rewrite) {
+    Node *node = *p;
+    switch (node->uop) {
+    case TK_INCREMENT:
+    case TK_DECREMENT:
+    {
+        int x = var_index(node->operand);
+        if (x < 0) {
+            eval_lval(&node->operand, env, rewrite);
+            return unknown;
+        }
+        // The value of a postfix increment/decrement is the old one.
+        Value old = env->vals[x];
+        Value v = unknown;
+        if (old.kind == VAL_CONST) {
+            int step = node->uop == TK_INCREMENT ? 1 : -1;
+            fold_binop('+', old.val, step, &v.val);
+            v.kind = VAL_CONST;
+        }
+        assign_var(env, x, v);
+        return old.kind == VAL_CONST ? old : unknown;
+    }
+    case '&':
+        eval_lval(&node->operand, env, rewrite);
+        return unknown;
+    case '*':
+        eval(&node->operand, env, rewrite);
+        return unknown;
+    case '+':
+    {
+        Value v = eval(&node->operand, env, rewrite);
+        return v.kind == VAL_CONST ? v : unknown;
+    }
+    case '-':
+    {
+        Value v = eval(&node->operand, env, rewrite);
+        if (v.kind == VAL_CONST && node->type && is_basic_type(node->type))
+            return const_value((int)(0u - (unsigned)v.val));
+        return unknown;
+    }
+    default:
+        return unknown;
+    }
+}
+
+static Value eval_assign(Node *node, Env *env, bool rewrite) {
+    Value v = eval(&node->rhs, env, rewrite);
+    int x = var_index(node->lhs);
+    if (x < 0) {
+        eval_lval(&node->lhs, env, rewrite);
+        return unknown;
+    }
+    v = assign_var(env, x, v);
+    return v.kind == VAL_CONST ? v : unknown;
+}
+
+// Evaluate an expression under the values of variables and update them with
+// its side effects. If rewrite is true, replace constant subexpressions and
+// copied variables.
+static Value eval(Node **p, Env *env, bool rewrite) {
+    Node *node = *p;
+    Value v = unknown;
+    switch (node->ty) {
+    case ND_NUM:
+        return const_value(node->val);
+    case ND_IDENT:
+    {
+        int x = var_index(node);
+        if (x < 0)
+            return unknown;
+        v = env->vals[x];
+        if (v.kind == VAL_UNKNOWN)
+            return (Value) { VAL_COPY, x };
+        if (v.kind == VAL_COPY && rewrite) {
+            Node *copy = clone(node);
+            copy->name = (char *)vars->data[v.val];
+            copy->type = (Type *)var_types->data[v.val];
+            *p = copy;
+            stats[ST_COPIES]++;
+        }
+        break;
+    }
+    case ND_STRING:
+        return unknown;
+    case ND_MEMBER:
+        eval_lval(&node->member_of, env, rewrite);
+        return unknown;
+    case ND_CALL:
+        for (int i = 0; i < node->fargs->len; i++)
+            eval((Node **)&node->fargs->data[i], env, rewrite);
+        return unknown;
+    case '=':
+        return eval_assign(node, env, rewrite);
+    case ND_COMMA:
+        eval(&node->lhs, env, rewrite);
+        return eval(&node->rhs, env, rewrite);
+    case ND_UEXPR:
+        v = eval_uexpr(p, env, rewrite);
+        break;
+    case ND_LOGICAL:
+        v = eval_logical(p, env, rewrite);
+        break;
+    default:
+        v = eval_binop(p, env, rewrite);
+        break;
+    }
+
+    if (rewrite && v.kind == VAL_CONST && (*p)->ty != ND_NUM && !has_side_effects(*p)) {
+        stats[(*p)->ty == ND_IDENT ? ST_CONSTANTS : ST_FOLDED]++;
+        *p = new_node_num(v.val);
+    }
+    return v;
+}
+
+static void exec(Node **p, Env *env, bool rewrite);
+
+// Values at the end of the innermost loop or switch statement merged from
+// the break statements leaving it. For the innermost switch statement, the
+// values on entry and the value switched on, and whether a case label has
+// the value if it is constant.
+static Env *break_env;
+static Env *switch_env;
+static Value switch_value;
+static bool switch_matched;
+
+static Env *new_unreachable_env(void) {
+    Env *env = new_env();
+    env->unreachable = true;
+    return env;
+}
+
+// Replace a statement whose condition is decided. Side effects of the
+// condition are kept.
+static void replace_decided(Node **p, Node *cond, Node *taken) {
+    Node *stmt = taken ? taken : new_node(ND_BLANK);
+    if (cond && has_side_effects(cond)) {
+        Node *comp = new_compound();
+        vec_push(comp->stmts, cond);
+        vec_push(comp->stmts, stmt);
+        stmt = comp;
+    }
+    *p = stmt;
+    stats[ST_BRANCHES]++;
+}
+
+static Value eval_loop_cond(Node *node, Env *env, bool rewrite) {
+    if (node->ty == ND_FOR && node->itercond->ty == ND_BLANK)
+        return const_value(1);
+    return eval(&node->itercond, env, rewrite);
+}
+
+static void exec_loop_body(Node *node, Env *env, bool rewrite) {
+    exec(&node->iterbody, env, rewrite);
+    if (node->ty == ND_FOR)
+        exec(&node->step, env, rewrite);
+}
+
+static void exec_loop(Node **p, Env *env, bool rewrite) {
+    Node *node = *p;
+    if (node->ty == ND_FOR)
+        exec(&node->iterinit, env, rewrite);
+
+    // Find the values at the head of the loop, merging those on entry and
+    // those at the end of each iteration until they no longer change.
+    Env *outer_break = break_env;
+    Env *head = copy_env(env);
+    for (;;) {
+        Env *e = copy_env(head);
+        Value cond = eval_loop_cond(node, e, false);
+        if (cond.kind == VAL_CONST && cond.val == 0)
+            break;
+        break_env = new_unreachable_env();
+        exec_loop_body(node, e, false);
+        if (!meet_env(head, e))
+            break;
+    }
+    break_env = new_unreachable_env();
+
+    Env *e = copy_env(head);
+    Value cond = eval_loop_cond(node, e, rewrite);
+    if (cond.kind == VAL_CONST && cond.val == 0) {
+        // The body is never executed.
+        if (rewrite) {
+            Node *comp = new_compound();
+            if (node->ty == ND_FOR)
+                vec_push(comp->stmts, node->iterinit);
+            vec_push(comp->stmts, node->itercond);
+            *p = comp;
+            stats[ST_BRANCHES]++;
+        }
+    } else {
+        exec_loop_body(node, copy_env(e), rewrite);
+    }
+
+    // Leave the loop when the condition is false or by a break.
+    *env = *e;
+    if (cond.kind == VAL_CONST && cond.val != 0)
+        env->unreachable = true;
+    meet_env(env, break_env);
+    break_env = outer_break;
+}
+
+// Execute the body of a switch statement, which is entered at the labels
+// that the value may match.
+static void exec_switch(Node *node, Env *env, bool rewrite) {
+    Value v = eval(&node->cond, env, rewrite);
+    Env *outer_break = break_env;
+    Env *outer_switch = switch_env;
+    Value outer_value = switch_value;
+    bool outer_matched = switch_matched;
+
+    Vector *stmts = node->then->stmts;
+    bool has_default = false;
+    switch_matched = false;
+    for (int i = 0; i < stmts->len; i++) {
+        const Node *stmt = (Node *)stmts->data[i];
+        if (stmt->ty == ND_DEFAULT)
+            has_default = true;
+        if (stmt->ty == ND_CASE && v.kind == VAL_CONST && stmt->val == v.val)
+            switch_matched = true;
+    }
+    switch_env = copy_env(env);
+    switch_value = v;
+    break_env = new_unreachable_env();
+    // Without a label to go to, control skips the body.
+    if (!has_default && (v.kind != VAL_CONST || !switch_matched))
+        meet_env(break_env, env);
+
+    env->unreachable = true;
+    for (int i = 0; i < stmts->len; i++)
+        exec((Node **)&stmts->data[i], env, rewrite);
+    meet_env(break_env, env);
+    *env = *break_env;
+
+    break_env = outer_break;
+    switch_env = outer_switch;
+    switch_value = outer_value;
+    switch_matched = outer_matched;
+}
+
+// Execute a statement under the values of variables.
+static void exec(Node **p, Env *env, bool rewrite) {
+    Node *node = *p;
+    if (node->ty == ND_CASE || node->ty == ND_DEFAULT) {
+        // Control also comes from the dispatch if the value may match.
+        bool taken = switch_value.kind != VAL_CONST
+            || (node->ty == ND_CASE ? node->val == switch_value.val : !switch_matched);
+        if (taken)
+            meet_env(env, switch_env);
+        return;
+    }
+    if (env->unreachable) {
+        if (rewrite && node->ty != ND_BLANK) {
+            *p = new_node(ND_BLANK);
+            stats[ST_UNREACHABLE]++;
+        }
+        return;
+    }
+
+    switch (node->ty) {
+    case ND_BLANK:
+        return;
+    case ND_DECLARATION:
+    {
+        if (!node->declinit)
+            return;
+        Value v = eval(&node->declinit, env, rewrite);
+        int x = var_index_of(node->name);
+        if (x >= 0)
+            assign_var(env, x, v);
+        return;
+    }
+    case ND_COMPOUND:
+        for (int i = 0; i < node->stmts->len; i++)
+            exec((Node **)&node->stmts->data[i], env, rewrite);
+        return;
+    case ND_RETURN:
+        eval(&node->rhs, env, rewrite);
+        env->unreachable = true;
+        return;
+    case ND_IF:
+    {
+        Value cond = eval(&node->cond, env, rewrite);
+        if (cond.kind == VAL_CONST) {
+            Node **taken = cond.val ? &node->then : &node->els;
+            if (*taken)
+                exec(taken, env, rewrite);
+            if (rewrite)
+                replace_decided(p, node->cond, *taken);
+            return;
+        }
+        Env *els_env = copy_env(env);
+        exec(&node->then, env, rewrite);
+        if (node->els)
+            exec(&node->els, els_env, rewrite);
+        meet_env(env, els_env);
+        return;
+    }
+    case ND_WHILE:
+    case ND_FOR:
+        exec_loop(p, env, rewrite);
+        return;
+    case ND_SWITCH:
+        exec_switch(node, env, rewrite);
+        return;
+    case ND_BREAK:
+        meet_env(break_env, env);
+        env->unreachable = true;
+        return;
+    case ND_VLOOP:
+    {
+        // The index and a sum are changed and nothing in it is rewritten.
+        int x = var_index(node->vindex);
+        if (x >= 0)
+            assign_var(env, x, unknown);
+        x = var_index(node->vstmt->lhs);
+        if (x >= 0)
+            assign_var(env, x, unknown);
+        return;
+    }
+    default:
+        // Expression statement.
+        eval(p, env, rewrite);
+        return;
+    }
+}
+
+// =============================================================================
+// Dead code elimination.
+// =============================================================================
+static int *reads;  // Number of reads of each variable.
+static int *refs;   // Number of reads and writes of each variable.
+
+static void count_expr(Node *node, int self);
+
+// Count uses in an expression assigned to variable x. Reads of x itself are
+// not counted if the result is used only by the store, e.g., x = x + 1.
+static void count_store(int x, Node *rhs) {
+    refs[x]++;
+    count_expr(rhs, has_side_effects(rhs) ? -1 : x);
+}
+
+static void count_expr(Node *node, int self) {
+    int x = -1;
+    switch (node->ty) {
+    case ND_IDENT:
+        x = var_index(node);
+        if (x >= 0) {
+            refs[x]++;
+            if (x != self)
+                reads[x]++;
+        }
+        return;
+    case '=':
+        x = var_index(node->lhs);
+        if (x >= 0) {
+            // The value of the assignment is used.
+            refs[x]++;
+            reads[x]++;
+            count_expr(node->rhs, self);
+            return;
+        }
+        break;
+    }
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        count_expr(*(Node **)slots->data[i], self);
+}
+
+static void count_stmt(Node *node) {
+    switch (node->ty) {
+    case ND_BLANK:
+        return;
+    case ND_DECLARATION:
+    {
+        int x = var_index_of(node->name);
+        if (node->declinit) {
+            if (x >= 0)
+                count_store(x, node->declinit);
+            else
+                count_expr(node->declinit, -1);
+        }
+        return;
+    }
+    case ND_COMPOUND:
+        for (int i = 0; i < node->stmts->len; i++)
+            count_stmt((Node *)node->stmts->data[i]);
+        return;
+    case ND_IF:
+    case ND_SWITCH:
+        count_expr(node->cond, -1);
+        count_stmt(node->then);
+        if (node->els)
+            count_stmt(node->els);
+        return;
+    case ND_CASE:
+    case ND_DEFAULT:
+    case ND_BREAK:
+        return;
+    case ND_WHILE:
+    case ND_FOR:
+        if (node->iterinit)
+            count_stmt(node->iterinit);
+        count_expr(node->itercond, -1);
+        count_stmt(node->iterbody);
+        if (node->step)
+            count_stmt(node->step);
+        return;
+    case ND_RETURN:
+        count_expr(node->rhs, -1);
+        return;
+    case '=':
+    {
+        int x = var_index(node->lhs);
+        if (x >= 0) {
+            count_store(x, node->rhs);
+            return;
+        }
+        break;
+    }
+    case ND_UEXPR:
+    {
+        int x = var_index(node->operand);
+        if (x >= 0 && (node->uop == TK_INCREMENT || node->uop == TK_DECREMENT)) {
+            refs[x]++;
+            return;
+        }
+        break;
+    }
+    }
+    // Expression statement.
+    count_expr(node, -1);
+}
+
+static bool is_dead_var(const Node *lhs) {
+    int x = var_index(lhs);
+    return x >= 0 && reads[x] == 0;
+}
+
+// Remove dead statements. Return true if anything is removed.
+static bool eliminate(Node **p) {
+    Node *node = *p;
+    bool changed = false;
+    switch (node->ty) {
+    case ND_BLANK:
+    case ND_RETURN:
+    case ND_DECLARATION:
+    case ND_CASE:
+    case ND_DEFAULT:
+    case ND_BREAK:
+        return false;
+
+    case ND_SWITCH:
+        return eliminate(&node->then);
+
+    case ND_COMPOUND:
+    {
+        Vector *stmts = new_vector();
+        for (int i = 0; i < node->stmts->len; i++) {
+            Node *stmt = (Node *)node->stmts->data[i];
+            changed |= eliminate(&stmt);
+            if (stmt->ty == ND_BLANK)
+                continue;
+            if (stmt->ty == ND_DECLARATION) {
+                int x = var_index_of(stmt->name);
+                if (x >= 0 && refs[x] == 0) {
+                    stats[ST_DEAD_VARS]++;
+                    changed = true;
+                    continue;
+                }
+                if (x >= 0 && reads[x] == 0 && stmt->declinit) {
+                    // Keep side effects of the initializer.
+                    Node *init = stmt->declinit;
+                    stmt->declinit = NULL;
+                    stats[ST_DEAD_STORES]++;
+                    changed = true;
+                    vec_push(stmts, stmt);
+                    eliminate(&init);
+                    if (init->ty != ND_BLANK)
+                        vec_push(stmts, init);
+                    continue;
+                }
+            }
+            vec_push(stmts, stmt);
+        }
+        node->stmts = stmts;
+        return changed;
+    }
+
+    case ND_IF:
+        changed |= eliminate(&node->then);
+        if (node->els)
+            changed |= eliminate(&node->els);
+        if (node->then->ty == ND_BLANK && (!node->els || node->els->ty == ND_BLANK)) {
+            *p = node->cond;
+            eliminate(p);
+            return true;
+        }
+        return changed;
+
+    case ND_WHILE:
+    case ND_FOR:
+        if (node->iterinit)
+            changed |= eliminate(&node->iterinit);
+        changed |= eliminate(&node->iterbody);
+        if (node->step)
+            changed |= eliminate(&node->step);
+        return changed;
+
+    case '=':
+        if (is_dead_var(node->lhs)) {
+            *p = node->rhs;
+            stats[ST_DEAD_STORES]++;
+            eliminate(p);
+            return true;
+        }
+        break;
+
+    case ND_UEXPR:
+        if ((node->uop == TK_INCREMENT || node->uop == TK_DECREMENT)
+                && is_dead_var(node->operand)) {
+            *p = new_node(ND_BLANK);
+            stats[ST_DEAD_STORES]++;
+            return true;
+        }
+        break;
+    }
+
+    // Expression statement whose value is unused.
+    if (!has_side_effects(node)) {
+        *p = new_node(ND_BLANK);
+        stats[ST_DEAD_EXPRS]++;
+        return true;
+    }
+    return false;
+}
+
+// =============================================================================
+// Memory dependence.
+//
+// A store to a local variable whose address is never taken changes only the
+// expressions that use the variable. Memory is told apart by the variable an
+// lvalue is a part of. An array or a struct local to the function is private
+// if its address never escapes, i.e., it is only used for member and element
+// accesses. Pointers may point to anything else.
+// =============================================================================
+// Return the name of the variable an lvalue is a part of, or NULL if it is
+// reached through a pointer.
+static const char *object_of(const Node *lval) {
+    switch (lval->ty) {
+    case ND_IDENT:
+        return lval->name;
+    case ND_MEMBER:
+        return object_of(lval->member_of);
+    case ND_UEXPR:
+    {
+        if (lval->uop != '*')
+            return NULL;
+        const Node *ptr = lval->operand;
+        if (ptr->type && ptr->type->ty == ARRAY && (ptr->ty == ND_IDENT || ptr->ty == ND_MEMBER))
+            return object_of(ptr);
+        if ((ptr->ty == '+' || ptr->ty == '-') && ptr->lhs->type && ptr->lhs->type->ty == ARRAY)
+            return object_of(ptr->lhs);
+        if (ptr->ty == '+' && ptr->rhs->type && ptr->rhs->type->ty == ARRAY)
+            return object_of(ptr->rhs);
+        return NULL;
+    }
+    default:
+        return NULL;
+    }
+}
+
+static bool is_private_object(const char *name) {
+    return name && contains_name(objects, name);
+}
+
+// Return true if a store to an lvalue may change the value of another one.
+static bool may_alias(const Node *store, const Node *load) {
+    const char *s = object_of(store);
+    const char *l = object_of(load);
+    if (s && l)
+        return strcmp(s, l) == 0;
+    if (!s && !l)
+        return true;
+    return !is_private_object(s ? s : l);
+}
+
+// Return true if an expression loads from memory that a store to an lvalue,
+// or a function call if lval is NULL, may change.
+static bool reads_clobbered(Node *node, const Node *lval) {
+    switch (node->ty) {
+    case ND_IDENT:
+        if (is_local(node) || !node->type || node->type->ty == ARRAY)
+            return false;
+        return !lval || may_alias(lval, node);
+    case ND_MEMBER:
+    case ND_UEXPR:
+        if (node->ty == ND_MEMBER || node->uop == '*') {
+            if (node->type && node->type->ty != ARRAY && node->type->ty != STRUCT) {
+                if (lval ? may_alias(lval, node) : !is_private_object(object_of(node)))
+                    return true;
+            }
+        }
+        break;
+    }
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        if (reads_clobbered(*(Node **)slots->data[i], lval))
+            return true;
+    return false;
+}
+
+static bool uses_name(Node *node, const char *name) {
+    if (node->ty == ND_IDENT)
+        return strcmp(node->name, name) == 0;
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        if (uses_name(*(Node **)slots->data[i], name))
+            return true;
+    return false;
+}
+
+// Return true if a store to an lvalue, or a function call if lval is NULL,
+// may change the value of an expression.
+static bool is_invalidated(Node *expr, const Node *lval) {
+    if (lval && lval->ty == ND_IDENT && is_local(lval))
+        return uses_name(expr, lval->name);
+    return reads_clobbered(expr, lval);
+}
+
+// Find arrays and structs whose addresses escape, i.e., which are used other
+// than for element and member accesses.
+static void find_escaped(Node *node, Vector *escaped) {
+    if (node->ty == ND_UEXPR && node->uop == '&') {
+        const char *name = object_of(node->operand);
+        if (name)
+            vec_push(escaped, name);
+    }
+    if ((node->ty == ND_IDENT || node->ty == ND_MEMBER) && node->type && node->type->ty == ARRAY) {
+        vec_push(escaped, object_of(node));
+        return;
+    }
+    if (node->ty == ND_MEMBER) {
+        // The struct is accessed, not used as a value.
+        if (node->member_of->ty != ND_IDENT)
+            find_escaped(node->member_of, escaped);
+        return;
+    }
+    if (node->ty == ND_UEXPR && node->uop == '*') {
+        // The base array of an element access does not escape.
+        Node *ptr = node->operand;
+        if (ptr->type && ptr->type->ty == ARRAY && (ptr->ty == ND_IDENT || ptr->ty == ND_MEMBER)) {
+            if (ptr->ty == ND_MEMBER)
+                find_escaped(ptr->member_of, escaped);
+            return;
+        }
+        if ((ptr->ty == '+' || ptr->ty == '-') && ptr->lhs->type && ptr->lhs->type->ty == ARRAY) {
+            if (ptr->lhs->ty == ND_MEMBER && ptr->lhs->member_of->ty != ND_IDENT)
+                find_escaped(ptr->lhs->member_of, escaped);
+            else if (ptr->lhs->ty != ND_IDENT && ptr->lhs->ty != ND_MEMBER)
+                find_escaped(ptr->lhs, escaped);
+            find_escaped(ptr->rhs, escaped);
+            return;
+        }
+    }
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        find_escaped(*(Node **)slots->data[i], escaped);
+}
+
+// =============================================================================
+// Common subexpression elimination.
+//
+// A pure expression is available at a point if it has been computed on every
+// path to the point, i.e., in a statement that dominates it, and nothing it
+// depends on has been stored to since. Statements are walked in the order the
+// code generator evaluates them. The first computation of an expression that
+// is reused is saved to a temporary variable and later ones read it.
+// =============================================================================
+// An available expression.
+typedef struct {
+    Node *expr;     // First occurrence.
+    Node *temp;     // Temporary variable, if it is reused.
+} Avail;
+
+static Vector *cse_firsts;  // All available expressions found.
+static Vector *cse_reuses;  // Occurrences that read an available expression.
+static Vector *cse_sources; // Available expressions that the above read.
+static Vector *cse_switch;  // Those available on entry to the switch body.
+
+static bool is_leaf(const Node *node) {
+    return node->ty == ND_NUM || (node->ty == ND_IDENT && node->type
+        && node->type->ty != ARRAY) || (node->ty == ND_MEMBER && is_static_lval(node));
+}
+
+static bool is_scalar(const Type *type) {
+    return type && (type->ty == PTR || is_basic_type(type));
+}
+
+static bool is_ptr_arith(const Node *node) {
+    return (node->ty == '+' || node->ty == '-')
+        && node->lhs->type && node->rhs->type
+        && (node->lhs->type->ty == PTR || node->lhs->type->ty == ARRAY
+            || node->rhs->type->ty == PTR || node->rhs->type->ty == ARRAY);
+}
+
+// Make a temporary variable to hold the value of an expression. Pointer
+// arithmetic on an array is held as a pointer to the element. A char or
+// short value is computed as an int, so it is held as an int, which it is
+// promoted to.
+static Node *new_temp_for(const Node *expr) {
+    Type *type = expr->type;
+    if (is_basic_type(type) && get_typesize(type) < 4) {
+        type = calloc(1, sizeof(Type));
+        type->ty = INT;
+    } else if (is_ptr_arith(expr)) {
+        const Node *ptr = expr->lhs->type->ty == PTR || expr->lhs->type->ty == ARRAY
+            ? expr->lhs : expr->rhs;
+        type = ptr_to(ptr->type->ptr_of);
+    }
+    return new_temp(type);
+}
+
+static bool is_cse_expr(const Node *node) {
+    switch (node->ty) {
+    case ND_NUM:
+    case ND_IDENT:
+        return true;
+    case ND_MEMBER:
+        return is_cse_expr(node->member_of);
+    case ND_UEXPR:
+        return (node->uop == '*' || node->uop == '-' || node->uop == '+')
+            && is_cse_expr(node->operand);
+    default:
+        if (!is_arith_operator(node->ty) && node->ty != '<' && node->ty != '>'
+                && node->ty != ND_LESSEQUAL && node->ty != ND_GREATEREQUAL
+                && node->ty != ND_EQUAL && node->ty != ND_NOTEQUAL)
+            return false;
+        return is_cse_expr(node->lhs) && is_cse_expr(node->rhs);
+    }
+}
+
+// Return true if an expression costs more than reading a temporary variable:
+// a load from a computed address, an address computation with a computed
+// index, or arithmetic on computed values.
+static bool is_cse_candidate(const Node *node) {
+    if (!is_cse_expr(node))
+        return false;
+    if (node->ty == ND_UEXPR && node->uop == '*')
+        return is_scalar(node->type) && !is_static_lval(node);
+    if (node->ty == ND_MEMBER)
+        return is_scalar(node->type) && !is_static_lval(node);
+    if (is_ptr_arith(node)) {
+        const Node *idx = node->lhs->type->ty == PTR || node->lhs->type->ty == ARRAY
+            ? node->rhs : node->lhs;
+        return !is_leaf(idx);
+    }
+    if (is_arith_operator(node->ty) && node->type && is_basic_type(node->type)) {
+        if (!is_leaf(node->lhs) || !is_leaf(node->rhs))
+            return true;
+        return (node->ty == '*' || node->ty == '/' || node->ty == '%')
+            && node->rhs->ty != ND_NUM;
+    }
+    return false;
+}
+
+static bool same_expr(const Node *a, const Node *b) {
+    if (a->ty != b->ty)
+        return false;
+    if (!a->type || !b->type || a->type->ty != b->type->ty
+            || get_typesize(a->type) != get_typesize(b->type))
+        return false;
+    switch (a->ty) {
+    case ND_NUM:
+        return a->val == b->val;
+    case ND_IDENT:
+        return strcmp(a->name, b->name) == 0;
+    case ND_MEMBER:
+        return strcmp(a->mname, b->mname) == 0 && same_expr(a->member_of, b->member_of);
+    case ND_UEXPR:
+        return a->uop == b->uop && same_expr(a->operand, b->operand);
+    default:
+        return same_expr(a->lhs, b->lhs) && same_expr(a->rhs, b->rhs);
+    }
+}
+
+// Remove available expressions invalidated by a store to an lvalue, or by a
+// function call if lval is NULL.
+static void kill(Vector *avail, const Node *lval) {
+    int n = 0;
+    for (int i = 0; i < avail->len; i++) {
+        Avail *a = (Avail *)avail->data[i];
+        if (!is_invalidated(a->expr, lval))
+            avail->data[n++] = a;
+    }
+    avail->len = n;
+}
+
+// Remove available expressions which are not available in the other set.
+static void intersect(Vector *avail, const Vector *other) {
+    int n = 0;
+    for (int i = 0; i < avail->len; i++) {
+        bool found = false;
+        for (int j = 0; j < other->len; j++)
+            if (avail->data[i] == other->data[j])
+                found = true;
+        if (found)
+            avail->data[n++] = avail->data[i];
+    }
+    avail->len = n;
+}
+
+// Apply the invalidation of every store in a subtree.
+static void kill_all(Node *node, Vector *avail) {
+    if (node->ty == '=')
+        kill(avail, node->lhs);
+    if (node->ty == ND_UEXPR && (node->uop == TK_INCREMENT || node->uop == TK_DECREMENT))
+        kill(avail, node->operand);
+    if (node->ty == ND_CALL)
+        kill(avail, NULL);
+    if (node->ty == ND_DECLARATION && node->declinit)
+        kill(avail, new_ident(node->name, node->type));
+    if (node->ty == ND_VLOOP)
+        kill(avail, node->vindex);
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        kill_all(*(Node **)slots->data[i], avail);
+}
+
+static void cse_expr(Node *node, Vector *avail);
+
+static void cse_lval(Node *node, Vector *avail) {
+    switch (node->ty) {
+    case ND_IDENT:
+        return;
+    case ND_MEMBER:
+        cse_lval(node->member_of, avail);
+        return;
+    case ND_UEXPR:
+        if (node->uop == '*') {
+            cse_expr(node->operand, avail);
+            return;
+        }
+        break;
+    }
+    cse_expr(node, avail);
+}
+
+static void cse_expr(Node *node, Vector *avail) {
+    if (is_cse_candidate(node)) {
+        for (int i = 0; i < avail->len; i++) {
+            Avail *a = (Avail *)avail->data[i];
+            if (same_expr(a->expr, node)) {
+                vec_push(cse_reuses, node);
+                vec_push(cse_sources, a);
+                return;
+            }
+        }
+    }
+
+    switch (node->ty) {
+    case '=':
+        // A computed address is evaluated before the value.
+        if (!is_static_lval(node->lhs))
+            cse_lval(node->lhs, avail);
+        cse_expr(node->rhs, avail);
+        kill(avail, node->lhs);
+        return;
+    case ND_UEXPR:
+        if (node->uop == TK_INCREMENT || node->uop == TK_DECREMENT) {
+            cse_lval(node->operand, avail);
+            kill(avail, node->operand);
+            return;
+        }
+        if (node->uop == '&') {
+            cse_lval(node->operand, avail);
+            return;
+        }
+        cse_expr(node->operand, avail);
+        break;
+    case ND_MEMBER:
+        cse_lval(node->member_of, avail);
+        break;
+    case ND_CALL:
+        // Arguments are evaluated from the last one.
+        for (int i = node->fargs->len - 1; i >= 0; i--)
+            cse_expr((Node *)node->fargs->data[i], avail);
+        kill(avail, NULL);
+        return;
+    case ND_LOGICAL:
+    {
+        cse_expr(node->llhs, avail);
+        Vector *rhs_avail = copy_vector(avail);
+        cse_expr(node->lrhs, rhs_avail);
+        intersect(avail, rhs_avail);
+        return;
+    }
+    default:
+    {
+        Vector *slots = children(node);
+        for (int i = 0; i < slots->len; i++)
+            cse_expr(*(Node **)slots->data[i], avail);
+        break;
+    }
+    }
+
+    if (is_cse_candidate(node)) {
+        Avail *a = calloc(1, sizeof(Avail));
+        a->expr = node;
+        vec_push(avail, a);
+        vec_push(cse_firsts, a);
+    }
+}
+
+static void cse_stmt(Node *node, Vector *avail) {
+    switch (node->ty) {
+    case ND_BLANK:
+        return;
+    case ND_VLOOP:
+        kill_all(node, avail);
+        return;
+    case ND_DECLARATION:
+        if (node->declinit)
+            cse_expr(node->declinit, avail);
+        if (node->declinit || node->zeroinit)
+            kill(avail, new_ident(node->name, node->type));
+        return;
+    case ND_COMPOUND:
+        for (int i = 0; i < node->stmts->len; i++)
+            cse_stmt((Node *)node->stmts->data[i], avail);
+        return;
+    case ND_RETURN:
+        cse_expr(node->rhs, avail);
+        return;
+    case ND_IF:
+    {
+        cse_expr(node->cond, avail);
+        Vector *then_avail = copy_vector(avail);
+        Vector *els_avail = copy_vector(avail);
+        cse_stmt(node->then, then_avail);
+        if (node->els)
+            cse_stmt(node->els, els_avail);
+        intersect(avail, then_avail);
+        intersect(avail, els_avail);
+        return;
+    }
+    case ND_SWITCH:
+    {
+        // The labels are also entered with the expressions available on
+        // entry. Only those that nothing in the body invalidates are
+        // available after it.
+        cse_expr(node->cond, avail);
+        Vector *outer = cse_switch;
+        cse_switch = copy_vector(avail);
+        cse_stmt(node->then, copy_vector(avail));
+        cse_switch = outer;
+        kill_all(node->then, avail);
+        return;
+    }
+    case ND_CASE:
+    case ND_DEFAULT:
+        intersect(avail, cse_switch);
+        return;
+    case ND_BREAK:
+        return;
+    case ND_WHILE:
+    case ND_FOR:
+    {
+        if (node->iterinit)
+            cse_stmt(node->iterinit, avail);
+        // Only the expressions which no iteration invalidates stay available
+        // in the loop.
+        kill_all(node->itercond, avail);
+        kill_all(node->iterbody, avail);
+        if (node->step)
+            kill_all(node->step, avail);
+        cse_expr(node->itercond, avail);
+        Vector *body_avail = copy_vector(avail);
+        cse_stmt(node->iterbody, body_avail);
+        if (node->step)
+            cse_stmt(node->step, body_avail);
+        // A break leaves the loop after the body may have invalidated what
+        // the condition computed.
+        if (breaks_out(node->iterbody))
+            kill_all(node->iterbody, avail);
+        return;
+    }
+    default:
+        cse_expr(node, avail);
+        return;
+    }
+}
+
+static Avail *find_source(const Node *node) {
+    for (int i = 0; i < cse_reuses->len; i++)
+        if (cse_reuses->data[i] == node)
+            return (Avail *)cse_sources->data[i];
+    return NULL;
+}
+
+static Avail *find_first(const Node *node) {
+    for (int i = 0; i < cse_firsts->len; i++) {
+        Avail *a = (Avail *)cse_firsts->data[i];
+        if (a->expr == node)
+            return a;
+    }
+    return NULL;
+}
+
+// Replace the first occurrences of reused expressions with assignments to
+// temporaries and the reuses with the temporaries.
+static void cse_rewrite(Node **p) {
+    Node *node = *p;
+    Avail *src = find_source(node);
+    if (src) {
+        *p = new_ident(src->temp->name, src->temp->type);
+        stats[ST_CSE]++;
+        return;
+    }
+
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        cse_rewrite((Node **)slots->data[i]);
+
+    Avail *first = find_first(node);
+    if (first && first->temp)
+        *p = new_node_binop('=', new_ident(first->temp->name, first->temp->type), node);
+}
+
+static void eliminate_common_subexprs(Node *body) {
+    cse_firsts = new_vector();
+    cse_reuses = new_vector();
+    cse_sources = new_vector();
+    cse_stmt(body, new_vector());
+    if (cse_reuses->len == 0)
+        return;
+
+    for (int i = 0; i < cse_sources->len; i++) {
+        Avail *a = (Avail *)cse_sources->data[i];
+        if (!a->temp)
+            a->temp = new_temp_for(a->expr);
+    }
+    cse_rewrite(&cur_func->fbody);
+    declare_temps();
+}
+
+// =============================================================================
+// Loop-invariant code motion.
+//
+// Control flow is structured, so every while and for statement is a natural
+// loop whose header evaluates the condition. A pure expression in a loop is
+// invariant if no store and no call in the loop may change its value. Such
+// expressions are computed once into temporary variables in a preheader run
+// before the loop. An expression that may trap, i.e., a load from a computed
+// address or a division, is hoisted only if the loop evaluates it whenever
+// it is entered. One from the body is computed only if the condition holds
+// on entry.
+// =============================================================================
+// When an expression is evaluated relative to the loop it is in.
+enum {
+    EVAL_ALWAYS,        // Whenever the loop is reached.
+    EVAL_IF_ENTERED,    // Whenever the body is entered.
+    EVAL_MAYBE,         // Possibly not at all.
+};
+
+static Vector *loop_stores;     // Lvalues stored to in the loop.
+static bool loop_calls;         // If the loop calls a function.
+static Vector *preheader;       // Hoisted expressions computed on entry.
+static Vector *guarded;         // Those computed if the body is entered.
+static int nloops;
+
+static void find_stores(Node *node) {
+    if (node->ty == '=')
+        vec_push(loop_stores, node->lhs);
+    if (node->ty == ND_UEXPR && (node->uop == TK_INCREMENT || node->uop == TK_DECREMENT))
+        vec_push(loop_stores, node->operand);
+    if (node->ty == ND_CALL)
+        loop_calls = true;
+    if (node->ty == ND_DECLARATION && (node->declinit || node->zeroinit))
+        vec_push(loop_stores, new_ident(node->name, node->type));
+    if (node->ty == ND_VLOOP)
+        vec_push(loop_stores, node->vindex);
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        find_stores(*(Node **)slots->data[i]);
+}
+
+static bool is_invariant(Node *expr) {
+    if (loop_calls && is_invalidated(expr, NULL))
+        return false;
+    for (int i = 0; i < loop_stores->len; i++)
+        if (is_invalidated(expr, (Node *)loop_stores->data[i]))
+            return false;
+    return true;
+}
+
+static bool may_trap(Node *node) {
+    if (node->ty == ND_UEXPR && node->uop == '*' && !is_static_lval(node))
+        return true;
+    if ((node->ty == '/' || node->ty == '%')
+            && (node->rhs->ty != ND_NUM || node->rhs->val == 0 || node->rhs->val == -1))
+        return true;
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        if (may_trap(*(Node **)slots->data[i]))
+            return true;
+    return false;
+}
+
+// Return true if control may not reach the statements after a statement,
+// including by a call that does not return or a loop that does not end.
+static bool may_leave(Node *node) {
+    if (node->ty == ND_RETURN || node->ty == ND_BREAK || node->ty == ND_CALL
+            || node->ty == ND_WHILE || node->ty == ND_FOR)
+        return true;
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        if (may_leave(*(Node **)slots->data[i]))
+            return true;
+    return false;
+}
+
+static Avail *find_hoisted(const Node *node) {
+    for (int i = 0; i < preheader->len; i++)
+        if (same_expr(((Avail *)preheader->data[i])->expr, node))
+            return (Avail *)preheader->data[i];
+    for (int i = 0; i < guarded->len; i++)
+        if (same_expr(((Avail *)guarded->data[i])->expr, node))
+            return (Avail *)guarded->data[i];
+    return NULL;
+}
+
+// Move an expression out of the loop and read a temporary instead.
+static void hoist(Node **p, Vector *to) {
+    Avail *a = calloc(1, sizeof(Avail));
+    a->expr = *p;
+    a->temp = new_temp_for(*p);
+    vec_push(to, a);
+    *p = new_ident(a->temp->name, a->temp->type);
+    stats[ST_HOISTED]++;
+}
+
+static void licm_expr(Node **p, int when);
+
+static void licm_lval(Node **p, int when) {
+    Node *node = *p;
+    switch (node->ty) {
+    case ND_IDENT:
+        return;
+    case ND_MEMBER:
+        licm_lval(&node->member_of, when);
+        return;
+    case ND_UEXPR:
+        if (node->uop == '*') {
+            licm_expr(&node->operand, when);
+            return;
+        }
+        break;
+    }
+    licm_expr(p, when);
+}
+
+// Hoist the largest invariant subexpressions of an expression.
+static void licm_expr(Node **p, int when) {
+    Node *node = *p;
+    if (is_cse_candidate(node) && is_invariant(node)) {
+        Avail *a = find_hoisted(node);
+        if (a) {
+            *p = new_ident(a->temp->name, a->temp->type);
+            return;
+        }
+        if (!may_trap(node) || when == EVAL_ALWAYS) {
+            hoist(p, preheader);
+            return;
+        }
+        if (when == EVAL_IF_ENTERED) {
+            hoist(p, guarded);
+            return;
+        }
+    }
+
+    switch (node->ty) {
+    case '=':
+        licm_lval(&node->lhs, when);
+        licm_expr(&node->rhs, when);
+        return;
+    case ND_UEXPR:
+        if (node->uop == TK_INCREMENT || node->uop == TK_DECREMENT || node->uop == '&') {
+            licm_lval(&node->operand, when);
+            return;
+        }
+        break;
+    case ND_MEMBER:
+        licm_lval(&node->member_of, when);
+        return;
+    case ND_LOGICAL:
+        licm_expr(&node->llhs, when);
+        licm_expr(&node->lrhs, EVAL_MAYBE);
+        return;
+    }
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        licm_expr((Node **)slots->data[i], when);
+}
+
+static void licm_stmt(Node **p, int when) {
+    Node *node = *p;
+    switch (node->ty) {
+    case ND_BLANK:
+    case ND_VLOOP:
+    case ND_CASE:
+    case ND_DEFAULT:
+    case ND_BREAK:
+        return;
+    case ND_DECLARATION:
+        if (node->declinit)
+            licm_expr(&node->declinit, when);
+        return;
+    case ND_COMPOUND:
+        for (int i = 0; i < node->stmts->len; i++) {
+            Node **slot = (Node **)&node->stmts->data[i];
+            if (may_leave(*slot))
+                when = EVAL_MAYBE;
+            licm_stmt(slot, when);
+        }
+        return;
+    case ND_IF:
+        licm_expr(&node->cond, when);
+        licm_stmt(&node->then, EVAL_MAYBE);
+        if (node->els)
+            licm_stmt(&node->els, EVAL_MAYBE);
+        return;
+    case ND_SWITCH:
+        licm_expr(&node->cond, when);
+        licm_stmt(&node->then, EVAL_MAYBE);
+        return;
+    case ND_WHILE:
+    case ND_FOR:
+    {
+        // Nested loops are optimized after this one.
+        Vector *slots = children(node);
+        for (int i = 0; i < slots->len; i++)
+            licm_stmt((Node **)slots->data[i], EVAL_MAYBE);
+        return;
+    }
+    default:
+        if (may_leave(node))
+            when = EVAL_MAYBE;
+        licm_expr(p, when);
+        return;
+    }
+}
+
+static void licm_loops(Node **p);
+
+static Node *assign_temps(const Vector *hoisted) {
+    Node *block = new_compound();
+    for (int i = 0; i < hoisted->len; i++) {
+        Avail *a = (Avail *)hoisted->data[i];
+        vec_push(block->stmts, new_node_binop('=', a->temp, a->expr));
+    }
+    return block;
+}
+
+// Replace a loop with { init; loop } where the loop starts at its condition.
+// Statements added to the returned block before the loop form its preheader.
+static Node *new_preheader(Node **p) {
+    Node *loop = *p;
+    Node *block = new_compound();
+    if (loop->iterinit && loop->iterinit->ty != ND_BLANK) {
+        vec_push(block->stmts, loop->iterinit);
+        loop->iterinit = new_node(ND_BLANK);
+    }
+    vec_push(block->stmts, loop);
+    *p = block;
+    return block;
+}
+
+static void add_to_preheader(Node *block, Node *stmt) {
+    Vector *stmts = block->stmts;
+    vec_push(stmts, stmts->data[stmts->len - 1]);
+    stmts->data[stmts->len - 2] = stmt;
+}
+
+// Compute invariant expressions of a loop in its preheader. Those that may
+// trap are computed under if (cond) { ... }.
+static void hoist_invariants(Node **p) {
+    Node *loop = *p;
+    int k = ++nloops;
+    loop_stores = new_vector();
+    loop_calls = false;
+    find_stores(loop->itercond);
+    find_stores(loop->iterbody);
+    if (loop->step)
+        find_stores(loop->step);
+
+    // The body is entered if the condition holds. It is evaluated again in
+    // the preheader only if it has no side effects.
+    preheader = new_vector();
+    guarded = new_vector();
+    const Node *cond = loop->itercond;
+    bool entered = cond->ty == ND_BLANK || (cond->ty == ND_NUM && cond->val != 0);
+    licm_expr(&loop->itercond, EVAL_ALWAYS);
+    licm_stmt(&loop->iterbody, entered ? EVAL_ALWAYS
+        : has_side_effects(loop->itercond) ? EVAL_MAYBE : EVAL_IF_ENTERED);
+    if (loop->step)
+        licm_stmt(&loop->step, EVAL_MAYBE);
+
+    int n = preheader->len + guarded->len;
+    if (opt_remarks)
+        fprintf(stderr, "opt: licm: %s: loop %d: hoisted %d\n", cur_func->fname, k, n);
+    if (n > 0) {
+        Node *block = new_preheader(p);
+        add_to_preheader(block, assign_temps(preheader));
+        if (guarded->len > 0) {
+            Node *guard = new_node(ND_IF);
+            guard->cond = clone(loop->itercond);
+            guard->then = assign_temps(guarded);
+            add_to_preheader(block, guard);
+        }
+    }
+    licm_loops(&loop->iterbody);
+}
+
+// Optimize loops from the outermost ones.
+static void licm_loops(Node **p) {
+    Node *node = *p;
+    if (node->ty == ND_WHILE || node->ty == ND_FOR) {
+        hoist_invariants(p);
+        return;
+    }
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        licm_loops((Node **)slots->data[i]);
+}
+
+static void hoist_loop_invariants(void) {
+    nloops = 0;
+    licm_loops(&cur_func->fbody);
+    declare_temps();
+}
+
+// =============================================================================
+// Induction variable strength reduction.
+//
+// A basic induction variable of a loop is an int variable that the loop
+// changes only by statements adding a constant to it, e.g., i++ in the step.
+// An address P + E, where P is an invariant pointer or array and E is the
+// variable plus invariant values, would be computed by scaling E in every
+// iteration. It is instead kept in a pointer variable, which is set in the
+// preheader and advanced together with the induction variable. If the
+// variable is used for nothing else than these addresses and the condition,
+// the condition compares the pointer with the end address instead and the
+// variable is no longer updated.
+// =============================================================================
+// A statement changing the induction variable.
+typedef struct {
+    Node **slot;
+    int step;
+} IVSite;
+
+// An address derived from the induction variable.
+typedef struct {
+    Node *expr;     // Base + index, computed in the preheader.
+    Node *ptr;      // Pointer variable holding it.
+    Vector *uses;   // Slots of the occurrences.
+} Derived;
+
+static const char *iv_name;
+static Vector *iv_sites;
+static Vector *iv_derived;
+
+// If a statement adds a constant to an int variable that the optimizer
+// follows, return the name of the variable and set the constant.
+static const char *iv_step(const Node *node, int *step) {
+    const Node *var;
+    if (node->ty == ND_UEXPR && (node->uop == TK_INCREMENT || node->uop == TK_DECREMENT)) {
+        var = node->operand;
+        *step = node->uop == TK_INCREMENT ? 1 : -1;
+    } else if (node->ty == '=' && (node->rhs->ty == '+' || node->rhs->ty == '-')) {
+        const Node *l = node->rhs->lhs;
+        const Node *r = node->rhs->rhs;
+        if (node->rhs->ty == '+' && l->ty == ND_NUM) {
+            l = node->rhs->rhs;
+            r = node->rhs->lhs;
+        }
+        if (l->ty != ND_IDENT || r->ty != ND_NUM || node->lhs->ty != ND_IDENT
+                || strcmp(l->name, node->lhs->name) != 0)
+            return NULL;
+        var = node->lhs;
+        *step = node->rhs->ty == '+' ? r->val : -r->val;
+    } else {
+        return NULL;
+    }
+    int x = var_index(var);
+    if (x < 0 || var_type(x)->ty != INT)
+        return NULL;
+    return var->name;
+}
+
+// Find the statements changing the induction variable.
+static void find_iv_sites(Node **p) {
+    Node *node = *p;
+    int step;
+    const char *name = iv_step(node, &step);
+    if (name && strcmp(name, iv_name) == 0) {
+        IVSite *site = calloc(1, sizeof(IVSite));
+        site->slot = p;
+        site->step = step;
+        vec_push(iv_sites, site);
+        return;
+    }
+    switch (node->ty) {
+    case ND_COMPOUND:
+        for (int i = 0; i < node->stmts->len; i++)
+            find_iv_sites((Node **)&node->stmts->data[i]);
+        return;
+    case ND_IF:
+        find_iv_sites(&node->then);
+        if (node->els)
+            find_iv_sites(&node->els);
+        return;
+    case ND_WHILE:
+    case ND_FOR:
+        if (node->iterinit)
+            find_iv_sites(&node->iterinit);
+        find_iv_sites(&node->iterbody);
+        if (node->step)
+            find_iv_sites(&node->step);
+        return;
+    }
+}
+
+static bool is_iv_site(Node **p) {
+    for (int i = 0; i < iv_sites->len; i++)
+        if (((IVSite *)iv_sites->data[i])->slot == p)
+            return true;
+    return false;
+}
+
+// Return true if an expression has the same value in every iteration and can
+// be computed in the preheader.
+static bool is_iv_invariant(Node *node) {
+    return !uses_name(node, iv_name) && !has_side_effects(node) && !may_trap(node)
+        && is_invariant(node);
+}
+
+// Return true if an expression is the induction variable plus invariant
+// values.
+static bool is_iv_index(Node *node) {
+    if (!node->type || node->type->ty != INT)
+        return false;
+    switch (node->ty) {
+    case ND_IDENT:
+        return strcmp(node->name, iv_name) == 0;
+    case '+':
+        return (is_iv_index(node->lhs) && is_iv_invariant(node->rhs))
+            || (is_iv_invariant(node->lhs) && is_iv_index(node->rhs));
+    case '-':
+        return is_iv_index(node->lhs) && is_iv_invariant(node->rhs);
+    default:
+        return false;
+    }
+}
+
+static bool is_derived(const Node *node) {
+    if (node->ty != '+')
+        return false;
+    if (is_ptr_like(node->lhs->type) && !is_ptr_like(node->rhs->type))
+        return is_iv_invariant(node->lhs) && is_iv_index(node->rhs);
+    if (is_ptr_like(node->rhs->type) && !is_ptr_like(node->lhs->type))
+        return is_iv_invariant(node->rhs) && is_iv_index(node->lhs);
+    return false;
+}
+
+static void find_derived(Node **p) {
+    if (is_iv_site(p) || (*p)->ty == ND_VLOOP)
+        return;
+    Node *node = *p;
+    if (is_derived(node)) {
+        for (int i = 0; i < iv_derived->len; i++) {
+            Derived *d = (Derived *)iv_derived->data[i];
+            if (same_expr(d->expr, node)) {
+                vec_push(d->uses, p);
+                return;
+            }
+        }
+        Derived *d = calloc(1, sizeof(Derived));
+        d->expr = node;
+        d->uses = new_vector();
+        vec_push(d->uses, p);
+        vec_push(iv_derived, d);
+        return;
+    }
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        find_derived((Node **)slots->data[i]);
+}
+
+// Number of reads of a variable.
+static int count_reads(Node *node, const char *name) {
+    if (node->ty == ND_IDENT)
+        return strcmp(node->name, name) == 0;
+    int n = 0;
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++) {
+        Node *child = *(Node **)slots->data[i];
+        if (node->ty == '=' && child == node->lhs && child->ty == ND_IDENT)
+            continue;
+        n += count_reads(child, name);
+    }
+    return n;
+}
+
+// Replace a variable in an expression with another expression.
+static void substitute(Node **p, const char *name, const Node *value) {
+    if ((*p)->ty == ND_IDENT && strcmp((*p)->name, name) == 0) {
+        *p = clone(value);
+        return;
+    }
+    Vector *slots = children(*p);
+    for (int i = 0; i < slots->len; i++)
+        substitute((Node **)slots->data[i], name, value);
+}
+
+// If the condition compares the induction variable with an invariant value
+// and the variable is read nowhere else, rewrite it to compare the first
+// derived pointer with the corresponding end address. Return true if it is
+// rewritten.
+static bool replace_iv_cond(Node *loop, Node *block) {
+    Node *cond = loop->itercond;
+    if (cond->ty != '<' && cond->ty != '>' && cond->ty != ND_LESSEQUAL
+            && cond->ty != ND_GREATEREQUAL && cond->ty != ND_NOTEQUAL)
+        return false;
+    Node **iv;
+    Node *limit;
+    if (cond->lhs->ty == ND_IDENT && strcmp(cond->lhs->name, iv_name) == 0) {
+        iv = &cond->lhs;
+        limit = cond->rhs;
+    } else if (cond->rhs->ty == ND_IDENT && strcmp(cond->rhs->name, iv_name) == 0) {
+        iv = &cond->rhs;
+        limit = cond->lhs;
+    } else {
+        return false;
+    }
+    if (!is_iv_invariant(limit))
+        return false;
+
+    // Reads by the statements changing it, the condition, and the initial
+    // values of the pointers.
+    int reads = 1;
+    for (int i = 0; i < iv_sites->len; i++)
+        reads += count_reads(*((IVSite *)iv_sites->data[i])->slot, iv_name);
+    for (int i = 0; i < iv_derived->len; i++)
+        reads += count_reads(((Derived *)iv_derived->data[i])->expr, iv_name);
+    if (count_reads(cur_func->fbody, iv_name) != reads)
+        return false;
+
+    // The addresses keep the order of the indices.
+    Derived *d = (Derived *)iv_derived->data[0];
+    Node *end_expr = clone(d->expr);
+    substitute(&end_expr, iv_name, limit);
+    Node *end = new_temp_for(end_expr);
+    add_to_preheader(block, new_node_binop('=', end, end_expr));
+    *iv = new_ident(d->ptr->name, d->ptr->type);
+    if (iv == &cond->lhs)
+        cond->rhs = new_ident(end->name, end->type);
+    else
+        cond->lhs = new_ident(end->name, end->type);
+    return true;
+}
+
+// Strength-reduce the addresses derived from an induction variable.
+static void reduce_iv(Node **p, const char *name) {
+    Node *loop = *p;
+    loop_stores = new_vector();
+    loop_calls = false;
+    find_stores(loop->itercond);
+    find_stores(loop->iterbody);
+    if (loop->step)
+        find_stores(loop->step);
+    iv_name = name;
+    iv_sites = new_vector();
+    iv_derived = new_vector();
+    find_iv_sites(&loop->iterbody);
+    if (loop->step)
+        find_iv_sites(&loop->step);
+    int nstores = 0;
+    for (int i = 0; i < loop_stores->len; i++) {
+        Node *lval = (Node *)loop_stores->data[i];
+        if (lval->ty == ND_IDENT && strcmp(lval->name, name) == 0)
+            nstores++;
+    }
+    if (nstores != iv_sites->len)
+        return;
+
+    find_derived(&loop->itercond);
+    find_derived(&loop->iterbody);
+    if (loop->step)
+        find_derived(&loop->step);
+    if (iv_derived->len == 0)
+        return;
+
+    Node *block = new_preheader(p);
+    for (int i = 0; i < iv_derived->len; i++) {
+        Derived *d = (Derived *)iv_derived->data[i];
+        d->ptr = new_temp_for(d->expr);
+        for (int j = 0; j < d->uses->len; j++)
+            *(Node **)d->uses->data[j] = new_ident(d->ptr->name, d->ptr->type);
+        add_to_preheader(block, new_node_binop('=', d->ptr, d->expr));
+        stats[ST_DERIVED]++;
+    }
+    bool removed = replace_iv_cond(loop, block);
+    if (removed)
+        stats[ST_REMOVED_IVS]++;
+
+    // Advance the pointers with the induction variable.
+    for (int i = 0; i < iv_sites->len; i++) {
+        IVSite *site = (IVSite *)iv_sites->data[i];
+        Node *stmt = removed ? NULL : *site->slot;
+        for (int j = 0; j < iv_derived->len; j++) {
+            Derived *d = (Derived *)iv_derived->data[j];
+            Node *ptr = new_ident(d->ptr->name, d->ptr->type);
+            Node *add = new_node_binop('+', new_ident(ptr->name, ptr->type), new_node_num(site->step));
+            Node *update = new_node_binop('=', ptr, add);
+            stmt = stmt ? new_comma(stmt, update) : update;
+        }
+        *site->slot = stmt;
+    }
+}
+
+// Strength-reduce loops from the innermost ones.
+static void reduce_loops(Node **p) {
+    Node *node = *p;
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        reduce_loops((Node **)slots->data[i]);
+    if (node->ty != ND_WHILE && node->ty != ND_FOR)
+        return;
+
+    loop_stores = new_vector();
+    loop_calls = false;
+    find_stores(node->itercond);
+    find_stores(node->iterbody);
+    if (node->step)
+        find_stores(node->step);
+
+    // Each candidate is tried on the loop, which may be in a preheader
+    // block by then.
+    Vector *names = new_vector();
+    for (int i = 0; i < loop_stores->len; i++) {
+        Node *lval = (Node *)loop_stores->data[i];
+        if (lval->ty == ND_IDENT && var_index(lval) >= 0 && !contains_name(names, lval->name))
+            vec_push(names, lval->name);
+    }
+    Node **slot = p;
+    for (int i = 0; i < names->len; i++) {
+        reduce_iv(slot, (const char *)names->data[i]);
+        if (*slot != node) {
+            Vector *stmts = (*slot)->stmts;
+            slot = (Node **)&stmts->data[stmts->len - 1];
+        }
+    }
+}
+
+static void reduce_induction_vars(void) {
+    reduce_loops(&cur_func->fbody);
+    declare_temps();
+}
+
+// =============================================================================
+// Loop vectorization.
+//
+// A for-loop running an induction variable i by one while i < n, where n is
+// invariant, is vectorized if its body is a single statement of the forms:
+// - c[i] = E, where E combines elements a[i] of the same size as those of c
+//   and invariant values with +, -, &, |, ^ and *. Lanes of the size of the
+//   elements compute the low bits of the results, which are all that these
+//   operators depend on.
+// - s += E, where s is an int variable and E is an element a[i] of any
+//   size, or an expression as above of int elements.
+// The array bases and the invariant values are computed into temporaries,
+// and a vectorized loop node, which the code generator emits with SIMD
+// instructions, runs before the original loop. The original loop runs the
+// remaining iterations. If the stored array may overlap a loaded one, the
+// vectorized loop runs only if the store does not lag behind the loads by
+// less than a vector.
+// =============================================================================
+#define MAX_VECTOR_DEPTH 6      // Vector registers for subexpressions.
+#define MAX_VECTOR_OPERANDS 5   // Base pointers and invariant values each.
+
+static Vector *vec_bases;       // Distinct array bases.
+static Vector *vec_scalars;     // Distinct invariant operands.
+
+// If an expression is an element a[i], return the array or pointer a.
+static Node *element_base(Node *node) {
+    if (node->ty != ND_UEXPR || node->uop != '*' || !node->type || !is_basic_type(node->type))
+        return NULL;
+    Node *ptr = node->operand;
+    if (ptr->ty != '+')
+        return NULL;
+    Node *base = is_ptr_like(ptr->lhs->type) ? ptr->lhs : ptr->rhs;
+    Node *index = base == ptr->lhs ? ptr->rhs : ptr->lhs;
+    if (!is_ptr_like(base->type) || index->ty != ND_IDENT || strcmp(index->name, iv_name) != 0)
+        return NULL;
+    return is_iv_invariant(base) ? base : NULL;
+}
+
+static void add_operand(Vector *operands, Node *node) {
+    for (int i = 0; i < operands->len; i++)
+        if (same_expr((Node *)operands->data[i], node))
+            return;
+    vec_push(operands, node);
+}
+
+// Return true if an expression can be computed in lanes of a size.
+static bool is_vector_expr(Node *node, int size, int depth) {
+    if (depth > MAX_VECTOR_DEPTH)
+        return false;
+    Node *base = element_base(node);
+    if (base) {
+        add_operand(vec_bases, base);
+        return (int)get_typesize(node->type) == size;
+    }
+    if (node->type && is_basic_type(node->type) && is_iv_invariant(node)) {
+        if (node->ty != ND_NUM)
+            add_operand(vec_scalars, node);
+        return true;
+    }
+    switch (node->ty) {
+    case '*':
+        if (size == 1 || (size == 4 && !use_avx2))
+            return false;
+        // Fall through.
+    case '+':
+    case '-':
+    case '&':
+    case '|':
+    case '^':
+        return is_vector_expr(node->lhs, size, depth + 1)
+            && is_vector_expr(node->rhs, size, depth + 1);
+    default:
+        return false;
+    }
+}
+
+// Replace the bases and the invariant operands with temporaries.
+static void replace_operands(Node **p, const Vector *operands, const Vector *temps) {
+    for (int i = 0; i < operands->len; i++) {
+        if (same_expr(*p, (Node *)operands->data[i])) {
+            Node *temp = (Node *)temps->data[i];
+            *p = new_ident(temp->name, temp->type);
+            return;
+        }
+    }
+    Vector *slots = children(*p);
+    for (int i = 0; i < slots->len; i++)
+        replace_operands((Node **)slots->data[i], operands, temps);
+}
+
+static Vector *assign_operands(Node *block, const Vector *operands) {
+    Vector *temps = new_vector();
+    for (int i = 0; i < operands->len; i++) {
+        Node *operand = (Node *)operands->data[i];
+        Node *temp = operand->type->ty == ARRAY
+            ? new_temp(ptr_to(operand->type->ptr_of)) : new_temp_for(operand);
+        add_to_preheader(block, new_node_binop('=', temp, clone(operand)));
+        vec_push(temps, temp);
+    }
+    return temps;
+}
+
+// Vectorize a loop. Return true if it is vectorized.
+static bool vectorize_loop(Node **p, int k) {
+    Node *loop = *p;
+    Node *cond = loop->itercond;
+    Node *stmt = loop->iterbody;
+    while (stmt->ty == ND_COMPOUND && stmt->stmts->len == 1)
+        stmt = (Node *)stmt->stmts->data[0];
+    int step;
+    const char *name = iv_step(loop->step, &step);
+    if (!name || step != 1 || cond->ty != '<' || cond->lhs->ty != ND_IDENT
+            || strcmp(cond->lhs->name, name) != 0 || stmt->ty != '=')
+        return false;
+
+    loop_stores = new_vector();
+    loop_calls = false;
+    find_stores(loop->itercond);
+    find_stores(loop->iterbody);
+    find_stores(loop->step);
+    iv_name = name;
+    if (loop_calls || loop_stores->len != 2 || !is_iv_invariant(cond->rhs))
+        return false;
+
+    vec_bases = new_vector();
+    vec_scalars = new_vector();
+    Node *store = NULL;
+    int size;
+    if (stmt->lhs->ty == ND_IDENT) {
+        // Reduction into an int variable.
+        int x = var_index(stmt->lhs);
+        Node *sum = stmt->rhs;
+        if (x < 0 || var_type(x)->ty != INT || strcmp(stmt->lhs->name, name) == 0
+                || sum->ty != '+')
+            return false;
+        Node *expr = sum->rhs;
+        if (sum->lhs->ty != ND_IDENT || strcmp(sum->lhs->name, stmt->lhs->name) != 0) {
+            if (sum->rhs->ty != ND_IDENT || strcmp(sum->rhs->name, stmt->lhs->name) != 0)
+                return false;
+            expr = sum->lhs;
+        }
+        if (uses_name(expr, stmt->lhs->name))
+            return false;
+        size = element_base(expr) ? (int)get_typesize(expr->type) : 4;
+        if (!is_vector_expr(expr, size, 0))
+            return false;
+    } else {
+        Node *base = element_base(stmt->lhs);
+        if (!base)
+            return false;
+        size = (int)get_typesize(stmt->lhs->type);
+        if (!is_vector_expr(stmt->rhs, size, 1))
+            return false;
+        store = stmt->lhs;
+        add_operand(vec_bases, base);
+    }
+    if (vec_bases->len > MAX_VECTOR_OPERANDS || vec_scalars->len > MAX_VECTOR_OPERANDS)
+        return false;
+
+    // The stored elements may overlap the loaded ones if they are not known
+    // to be in different objects.
+    int lanes = (use_avx2 ? 32 : 16) / size;
+    Node *check = NULL;
+    Node *block = new_preheader(p);
+    Vector *bases = assign_operands(block, vec_bases);
+    Vector *scalars = assign_operands(block, vec_scalars);
+    if (store) {
+        Node *c = element_base(store);
+        Node *tc = (Node *)bases->data[bases->len - 1];
+        for (int i = 0; i < vec_bases->len - 1; i++) {
+            Node *a = (Node *)vec_bases->data[i];
+            Node *load = new_node_uop('*', new_node_binop('+', a, new_ident(name, cond->lhs->type)));
+            if (same_expr(a, c) || !may_alias(store, load))
+                continue;
+            Node *ta = (Node *)bases->data[i];
+            Node *behind = new_node_binop(ND_LESSEQUAL, new_ident(tc->name, tc->type),
+                new_ident(ta->name, ta->type));
+            Node *ahead = new_node_binop(ND_LESSEQUAL, new_node_binop('+',
+                new_ident(ta->name, ta->type), new_node_num(lanes)), new_ident(tc->name, tc->type));
+            Node *disjoint = new_node_logical('|', behind, ahead);
+            check = check ? new_node_logical('&', check, disjoint) : disjoint;
+        }
+    }
+
+    Node *vloop = new_node(ND_VLOOP);
+    vloop->vindex = new_ident(name, cond->lhs->type);
+    vloop->vlimit = cond->rhs;
+    if (!is_leaf(cond->rhs)) {
+        Node *limit = new_temp_for(cond->rhs);
+        add_to_preheader(block, new_node_binop('=', limit, clone(cond->rhs)));
+        vloop->vlimit = new_ident(limit->name, limit->type);
+    } else {
+        vloop->vlimit = clone(cond->rhs);
+    }
+    vloop->vstmt = clone(stmt);
+    replace_operands(&vloop->vstmt->rhs, vec_scalars, scalars);
+    replace_operands(&vloop->vstmt->rhs, vec_bases, bases);
+    if (store)
+        replace_operands(&vloop->vstmt->lhs, vec_bases, bases);
+    if (check) {
+        Node *guard = new_node(ND_IF);
+        guard->cond = check;
+        guard->then = vloop;
+        vloop = guard;
+    }
+    add_to_preheader(block, vloop);
+
+    stats[ST_VECTORIZED]++;
+    if (opt_remarks)
+        fprintf(stderr, "opt: vectorize: %s: loop %d: %d lanes%s\n", cur_func->fname, k,
+            lanes, check ? ", checked for overlap" : "");
+    return true;
+}
+
+static void vectorize_loops(Node **p) {
+    Node *node = *p;
+    int k = 0;
+    if (node->ty == ND_WHILE || node->ty == ND_FOR)
+        k = ++nloops;
+    if (node->ty == ND_FOR && vectorize_loop(p, k))
+        return;
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        vectorize_loops((Node **)slots->data[i]);
+}
+
+// =============================================================================
+// Loop unrolling.
+//
+// A for-loop has a known trip count if its init sets an induction variable,
+// its step is the only statement changing it, and its condition compares it
+// with an invariant limit. A loop with a constant trip count and a small body
+// is unrolled fully into copies of the body and the step, in which constant
+// propagation then replaces the variable with constants. Other loops are
+// unrolled by a factor chosen from the size of the body, or given by
+// -funroll-loops=N, into a loop running that many copies per test. The
+// original loop follows it to run the remaining iterations.
+// =============================================================================
+#define FULL_UNROLL_BUDGET 256  // Nodes after unrolling a loop fully.
+#define UNROLL_BUDGET 64        // Nodes in the body of an unrolled loop.
+#define MAX_UNROLL_FACTOR 4
+
+static int count_nodes(Node *node) {
+    int n = 1;
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        n += count_nodes(*(Node **)slots->data[i]);
+    return n;
+}
+
+static bool has_declaration(Node *node) {
+    if (node->ty == ND_DECLARATION)
+        return true;
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        if (has_declaration(*(Node **)slots->data[i]))
+            return true;
+    return false;
+}
+
+// Return the number of iterations of "for (i = init; i op limit; i += step)",
+// or -1 if the loop does not end by the condition.
+static long long trip_count(int op, int init, int limit, int step) {
+    long long d = (long long)limit - init;
+    switch (op) {
+    case '<':
+        return step < 0 ? -1 : d <= 0 ? 0 : (d + step - 1) / step;
+    case ND_LESSEQUAL:
+        return step < 0 ? -1 : d < 0 ? 0 : d / step + 1;
+    case '>':
+        return step > 0 ? -1 : d >= 0 ? 0 : (d + step + 1) / step;
+    case ND_GREATEREQUAL:
+        return step > 0 ? -1 : d > 0 ? 0 : d / step + 1;
+    case ND_NOTEQUAL:
+        return d % step != 0 || d / step < 0 ? -1 : d / step;
+    default:
+        return -1;
+    }
+}
+
+static void add_copies(Node *block, const Node *loop, long long n) {
+    for (long long i = 0; i < n; i++) {
+        vec_push(block->stmts, clone(loop->iterbody));
+        vec_push(block->stmts, clone(loop->step));
+    }
+}
+
+// Unroll a loop with a known trip count. Return true if it is unrolled.
+static bool unroll_loop(Node **p, int k) {
+    Node *loop = *p;
+    Node *init = loop->iterinit;
+    Node *cond = loop->itercond;
+    int step;
+    const char *name = iv_step(loop->step, &step);
+    if (!name || step == 0 || init->ty != '=' || init->lhs->ty != ND_IDENT
+            || strcmp(init->lhs->name, name) != 0)
+        return false;
+    if (cond->ty != '<' && cond->ty != '>' && cond->ty != ND_LESSEQUAL
+            && cond->ty != ND_GREATEREQUAL && cond->ty != ND_NOTEQUAL)
+        return false;
+    if (cond->lhs->ty != ND_IDENT || strcmp(cond->lhs->name, name) != 0)
+        return false;
+
+    loop_stores = new_vector();
+    loop_calls = false;
+    find_stores(loop->itercond);
+    find_stores(loop->iterbody);
+    find_stores(loop->step);
+    int nstores = 0;
+    for (int i = 0; i < loop_stores->len; i++) {
+        Node *lval = (Node *)loop_stores->data[i];
+        if (lval->ty == ND_IDENT && strcmp(lval->name, name) == 0)
+            nstores++;
+    }
+    if (nstores != 1)
+        return false;
+    iv_name = name;
+    Node *limit = cond->rhs;
+    if (!is_iv_invariant(limit) || has_declaration(loop->iterbody)
+            || breaks_out(loop->iterbody))
+        return false;
+
+    int size = count_nodes(loop->iterbody) + count_nodes(loop->step);
+    if (init->rhs->ty == ND_NUM && limit->ty == ND_NUM) {
+        long long n = trip_count(cond->ty, init->rhs->val, limit->val, step);
+        if (n >= 0 && n * size <= FULL_UNROLL_BUDGET) {
+            Node *block = new_compound();
+            vec_push(block->stmts, init);
+            add_copies(block, loop, n);
+            *p = block;
+            stats[ST_FULLY_UNROLLED]++;
+            if (opt_remarks)
+                fprintf(stderr, "opt: unroll: %s: loop %d: unrolled fully, %lld iterations\n",
+                    cur_func->fname, k, n);
+            return true;
+        }
+    }
+
+    int factor = unroll_factor;
+    if (factor == 0)
+        for (factor = MAX_UNROLL_FACTOR; factor > 1 && factor * size > UNROLL_BUDGET; factor /= 2)
+            ;
+    if (factor <= 1 || cond->ty == ND_NOTEQUAL || trip_count(cond->ty, 0, 0, step) < 0)
+        return false;
+
+    // The unrolled loop runs while the last copy would still run, i.e.,
+    // i op limit - (factor - 1) * step. The subtraction must not overflow.
+    int span = (factor - 1) * step;
+    Node *guard = NULL;
+    if (span > 0)
+        guard = new_node_binop(ND_GREATEREQUAL, clone(limit), new_node_num(INT_MIN + span));
+    else
+        guard = new_node_binop(ND_LESSEQUAL, clone(limit), new_node_num(INT_MAX + span));
+    if (limit->ty == ND_NUM) {
+        if (span > 0 ? limit->val < INT_MIN + span : limit->val > INT_MAX + span)
+            return false;
+        guard = NULL;
+    }
+
+    Node *unrolled = new_node(ND_FOR);
+    unrolled->iterinit = new_node(ND_BLANK);
+    unrolled->itercond = new_node_binop(cond->ty, clone(cond->lhs),
+        new_node_binop('-', clone(limit), new_node_num(span)));
+    unrolled->iterbody = new_compound();
+    add_copies(unrolled->iterbody, loop, factor);
+    unrolled->step = new_node(ND_BLANK);
+
+    Node *block = new_compound();
+    vec_push(block->stmts, init);
+    if (guard) {
+        Node *node = new_node(ND_IF);
+        node->cond = guard;
+        node->then = unrolled;
+        vec_push(block->stmts, node);
+    } else {
+        vec_push(block->stmts, unrolled);
+    }
+    loop->iterinit = new_node(ND_BLANK);
+    vec_push(block->stmts, loop);
+    *p = block;
+    stats[ST_UNROLLED]++;
+    if (opt_remarks)
+        fprintf(stderr, "opt: unroll: %s: loop %d: unrolled by %d\n", cur_func->fname, k, factor);
+    return true;
+}
+
+// Unroll loops from the innermost ones. Return true if any is unrolled.
+static bool unroll_loops(Node **p) {
+    Node *node = *p;
+    int k = 0;
+    if (node->ty == ND_WHILE || node->ty == ND_FOR)
+        k = ++nloops;
+    bool changed = false;
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        changed |= unroll_loops((Node **)slots->data[i]);
+    if (node->ty == ND_FOR)
+        changed |= unroll_loop(p, k);
+    return changed;
+}
+
+// =============================================================================
+// Inlining.
+//
+// A call to a function defined in the translation unit is replaced with its
+// body if the body is small and straight-line: declarations and expression
+// statements followed by an optional return statement. The body becomes a
+// comma expression that assigns the arguments to the parameters and yields
+// the returned value. The parameters and the local variables of the callee
+// are renamed and declared in the caller, where the other passes follow them
+// like the caller's own variables. Calls in an inlined body are inlined in
+// turn up to MAX_INLINE_DEPTH levels.
+// =============================================================================
+#define MAX_INLINE_DEPTH 4
+
+// Number of inlined calls, which numbers the renamed variables.
+static int ninlined;
+
+// Copy a tree, renaming variables with names in from to those in to.
+// Unlike clone(), a subtree shared by the parser, e.g., the lhs of "x += 1",
+// stays shared in the copy, which lower_compound_assign() relies on.
+static Node *copy_renamed(Node *node, Vector *orig, Vector *copies,
+        const Vector *from, const Vector *to) {
+    for (int i = 0; i < orig->len; i++)
+        if (orig->data[i] == node)
+            return (Node *)copies->data[i];
+
+    Node *copy = malloc(sizeof(Node));
+    *copy = *node;
+    vec_push(orig, node);
+    vec_push(copies, copy);
+    if (node->ty == ND_CALL)
+        copy->fargs = copy_vector(node->fargs);
+    else if (node->ty == ND_COMPOUND)
+        copy->stmts = copy_vector(node->stmts);
+    if (node->ty == ND_IDENT || node->ty == ND_DECLARATION)
+        for (int i = 0; i < from->len; i++)
+            if (strcmp(node->name, from->data[i]) == 0)
+                copy->name = (char *)to->data[i];
+
+    Vector *slots = children(copy);
+    for (int i = 0; i < slots->len; i++) {
+        Node **slot = (Node **)slots->data[i];
+        *slot = copy_renamed(*slot, orig, copies, from, to);
+    }
+    return copy;
+}
+
+static bool is_statement(const Node *node) {
+    switch (node->ty) {
+    case ND_GOTO:
+    case ND_RETURN:
+    case ND_COMPOUND:
+    case ND_IF:
+    case ND_SWITCH:
+    case ND_WHILE:
+    case ND_FOR:
+    case ND_VLOOP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void find_free_names(Node *node, const Vector *bound, Vector *names) {
+    if (node->ty == ND_IDENT && !contains_name(bound, node->name))
+        vec_push(names, node->name);
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        find_free_names(*(Node **)slots->data[i], bound, names);
+}
+
+static Node *find_funcdef(const Vector *funcdefs, const char *name) {
+    for (int i = 0; i < funcdefs->len; i++) {
+        Node *func = (Node *)funcdefs->data[i];
+        if (strcmp(func->fname, name) == 0)
+            return func;
+    }
+    return NULL;
+}
+
+static bool calls_function(Node *node, const char *name) {
+    if (node->ty == ND_CALL && strcmp(node->name, name) == 0)
+        return true;
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        if (calls_function(*(Node **)slots->data[i], name))
+            return true;
+    return false;
+}
+
+static void find_decls(Node *node, Vector *names) {
+    if (node->ty == ND_DECLARATION)
+        vec_push(names, node->name);
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        find_decls(*(Node **)slots->data[i], names);
+}
+
+// Names of the parameters and the local variables of a function.
+static Vector *local_names(Node *func) {
+    Vector *names = new_vector();
+    for (int i = 0; i < func->fargs->len; i++)
+        vec_push(names, ((Node *)func->fargs->data[i])->name);
+    find_decls(func->fbody, names);
+    return names;
+}
+
+static bool can_inline(Node *caller, Node *callee, const Node *call) {
+    if (callee == caller || call->fargs->len != callee->fargs->len)
+        return false;
+    if (count_nodes(callee->fbody) > inline_limit || calls_function(callee->fbody, callee->fname))
+        return false;
+    // Labels are unique in a function.
+    if (has_goto(callee->fbody))
+        return false;
+    // Struct values are passed by copying memory, which assignments of the
+    // parameters would not do.
+    if (callee->type->ty == STRUCT)
+        return false;
+    for (int i = 0; i < callee->fargs->len; i++)
+        if (((Node *)callee->fargs->data[i])->type->ty == STRUCT)
+            return false;
+    Vector *stmts = callee->fbody->stmts;
+    for (int i = 0; i < stmts->len; i++) {
+        Node *stmt = (Node *)stmts->data[i];
+        if (stmt->ty == ND_RETURN && i == stmts->len - 1)
+            continue;
+        if (is_statement(stmt))
+            return false;
+        // Declarations are moved to the entry of the caller, where zeroing
+        // would not be repeated for each call.
+        if (stmt->ty == ND_DECLARATION && stmt->zeroinit)
+            return false;
+    }
+
+    // A global variable used by the callee must not be hidden by a local
+    // variable of the caller.
+    Vector *free_names = new_vector();
+    find_free_names(callee->fbody, local_names(callee), free_names);
+    Vector *caller_names = local_names(caller);
+    for (int i = 0; i < free_names->len; i++)
+        if (contains_name(caller_names, free_names->data[i]))
+            return false;
+    return true;
+}
+
+static Node *new_assign(Node *lhs, Node *rhs) {
+    Node *node = new_node('=');
+    node->lhs = lhs;
+    node->rhs = rhs;
+    node->type = lhs->type;
+    return node;
+}
+
+// Make a comma expression evaluating the body of callee for a call. The
+// declarations of the renamed variables are added to decls.
+static Node *expand_call(Node *callee, Node *call, Vector *decls) {
+    int n = ninlined++;
+    Vector *from = local_names(callee);
+    Vector *to = new_vector();
+    for (int i = 0; i < from->len; i++) {
+        const char *name = from->data[i];
+        char *renamed = malloc(strlen(name) + 16);
+        sprintf(renamed, "%s.%d", name, n);
+        vec_push(to, renamed);
+    }
+    Node *body = copy_renamed(callee->fbody, new_vector(), new_vector(), from, to);
+
+    Vector *exprs = new_vector();
+    for (int i = 0; i < callee->fargs->len; i++) {
+        Node *param = copy_renamed((Node *)callee->fargs->data[i], new_vector(), new_vector(), from, to);
+        Node *decl = new_node(ND_DECLARATION);
+        decl->name = param->name;
+        decl->type = param->type;
+        vec_push(decls, decl);
+        vec_push(exprs, new_assign(param, (Node *)call->fargs->data[i]));
+    }
+    Node *value = NULL;
+    for (int i = 0; i < body->stmts->len; i++) {
+        Node *stmt = (Node *)body->stmts->data[i];
+        if (stmt->ty == ND_RETURN) {
+            value = stmt->rhs;
+        } else if (stmt->ty == ND_DECLARATION) {
+            vec_push(decls, stmt);
+            if (stmt->declinit)
+                vec_push(exprs, new_assign(new_ident(stmt->name, stmt->type), stmt->declinit));
+            stmt->declinit = NULL;
+        } else if (stmt->ty != ND_BLANK) {
+            vec_push(exprs, stmt);
+        }
+    }
+
+    // A call yields its return type whatever the type of the returned
+    // expression.
+    if (!value) {
+        value = new_node_num(0);
+    } else if (value->type->ty != call->type->ty) {
+        char *name = malloc(16);
+        sprintf(name, ".r%d", n);
+        Node *decl = new_node(ND_DECLARATION);
+        decl->name = name;
+        decl->type = call->type;
+        vec_push(decls, decl);
+        Node *result = new_ident(name, call->type);
+        vec_push(exprs, new_assign(result, value));
+        value = new_ident(name, call->type);
+    }
+    for (int i = exprs->len - 1; i >= 0; i--)
+        value = new_comma((Node *)exprs->data[i], value);
+    return value;
+}
+
+static void inline_calls(Node *caller, Node **p, const Vector *funcdefs, Vector *decls, int depth) {
+    Node *node = *p;
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        inline_calls(caller, (Node **)slots->data[i], funcdefs, decls, depth);
+    if (node->ty != ND_CALL || depth >= MAX_INLINE_DEPTH)
+        return;
+
+    Node *callee = find_funcdef(funcdefs, node->name);
+    if (!callee || !can_inline(caller, callee, node))
+        return;
+    *p = expand_call(callee, node, decls);
+    stats[ST_INLINED]++;
+    if (opt_remarks)
+        fprintf(stderr, "opt: inline: %s: %s\n", caller->fname, callee->fname);
+    inline_calls(caller, p, funcdefs, decls, depth + 1);
+}
+
+// Inline calls in all functions. This runs before optimize() so that the
+// inlined bodies are optimized together with the callers.
+void inline_functions(Vector *funcdefs) {
+    if (inline_limit == 0)
+        return;
+    for (int i = 0; i < funcdefs->len; i++) {
+        Node *func = (Node *)funcdefs->data[i];
+        Vector *decls = new_vector();
+        inline_calls(func, &func->fbody, funcdefs, decls, 0);
+        for (int j = 0; j < func->fbody->stmts->len; j++)
+            vec_push(decls, func->fbody->stmts->data[j]);
+        func->fbody->stmts = decls;
+    }
+}
+
+// =============================================================================
+// Driver.
+// =============================================================================
+static void add_var(Vector *excluded, const char *name, Type *type) {
+    if (contains_name(locals, name)) {
+        // Redeclared with another type.
+        int x = var_index_of(name);
+        if (x < 0 || var_type(x)->ty != type->ty)
+            vec_push(excluded, name);
+        return;
+    }
+    vec_push(locals, name);
+    if (is_basic_type(type)) {
+        vec_push(vars, name);
+        vec_push(var_types, type);
+    }
+}
+
+// Find variables whose addresses are taken or declared in an inner scope.
+static void find_excluded(Node *node, Vector *excluded, bool top) {
+    if (node->ty == ND_UEXPR && node->uop == '&' && node->operand->ty == ND_IDENT)
+        vec_push(excluded, node->operand->name);
+    if (node->ty == ND_DECLARATION && !top)
+        vec_push(excluded, node->name);
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        find_excluded(*(Node **)slots->data[i], excluded, false);
+}
+
+// Collect the parameters and local variables whose addresses are never
+// taken, and those of them that the optimizer follows the values of.
+static void collect_vars(Node *func) {
+    vars = new_vector();
+    var_types = new_vector();
+    locals = new_vector();
+    Vector *excluded = new_vector();
+    for (int i = 0; i < func->fargs->len; i++) {
+        Node *param = (Node *)func->fargs->data[i];
+        add_var(excluded, param->name, param->type);
+    }
+    Vector *stmts = func->fbody->stmts;
+    for (int i = 0; i < stmts->len; i++) {
+        Node *stmt = (Node *)stmts->data[i];
+        if (stmt->ty == ND_DECLARATION)
+            add_var(excluded, stmt->name, stmt->type);
+        find_excluded(stmt, excluded, true);
+    }
+
+    Vector *names = locals;
+    Vector *types = var_types;
+    locals = new_vector();
+    for (int i = 0; i < names->len; i++)
+        if (!contains_name(excluded, names->data[i]))
+            vec_push(locals, names->data[i]);
+    Vector *escaped = new_vector();
+    find_escaped(func->fbody, escaped);
+    objects = new_vector();
+    for (int i = 0; i < locals->len; i++)
+        if (!contains_name(escaped, locals->data[i]))
+            vec_push(objects, locals->data[i]);
+
+    names = vars;
+    vars = new_vector();
+    var_types = new_vector();
+    for (int i = 0; i < names->len; i++) {
+        if (!contains_name(excluded, names->data[i])) {
+            vec_push(vars, names->data[i]);
+            vec_push(var_types, types->data[i]);
+        }
+    }
+}
+
+static void propagate_and_eliminate(void) {
+    // Propagation exposes dead code and removing dead code may expose more
+    // constants, e.g., of a variable whose other stores are removed.
+    bool changed = true;
+    for (int round = 0; changed && round < 8; round++) {
+        exec(&cur_func->fbody, new_env(), true);
+
+        reads = calloc(vars->len + 1, sizeof(int));
+        refs = calloc(vars->len + 1, sizeof(int));
+        count_stmt(cur_func->fbody);
+        changed = eliminate(&cur_func->fbody);
+    }
+}
+
+void optimize(Node *func) {
+    cur_func = func;
+    // The passes follow the nesting of statements, which a goto may jump
+    // across, so such a function is left as it is.
+    if (has_goto(func->fbody)) {
+        if (opt_remarks)
+            fprintf(stderr, "opt: %s: not optimized for goto\n", func->fname);
+        return;
+    }
+    ntemps = 0;
+    temp_decls = new_vector();
+    locals = new_vector();
+    lower_compound_assign(&func->fbody);
+    declare_temps();
+    func->fbody = clone(func->fbody);
+    collect_vars(func);
+
+    propagate_and_eliminate();
+    nloops = 0;
+    vectorize_loops(&func->fbody);
+    declare_temps();
+    nloops = 0;
+    if (unroll_loops(&func->fbody))
+        propagate_and_eliminate();
+    hoist_loop_invariants();
+    reduce_induction_vars();
+    eliminate_common_subexprs(func->fbody);
+}
+
+// Return true if the address of a parameter or a local variable may be
+// taken. The frame of such a function must outlive the calls it makes.
+bool frame_escapes(Node *func) {
+    Vector *names = new_vector();
+    for (int i = 0; i < func->fargs->len; i++)
+        vec_push(names, ((Node *)func->fargs->data[i])->name);
+    find_decls(func->fbody, names);
+    Vector *escaped = new_vector();
+    find_escaped(func->fbody, escaped);
+    for (int i = 0; i < escaped->len; i++)
+        if (escaped->data[i] && contains_name(names, escaped->data[i]))
+            return true;
+    return false;
+}
+
+// Return true if an expression or a statement makes a call.
+bool has_call(const Node *node) {
+    if (node->ty == ND_CALL)
+        return true;
+    Vector *slots = children((Node *)node);
+    for (int i = 0; i < slots->len; i++)
+        if (has_call(*(Node **)slots->data[i]))
+            return true;
+    return false;
+}
+
+// Return true if a function makes no calls.
+bool is_leaf_function(Node *func) {
+    return !has_call(func->fbody);
+}
+
+// Collect the calls in an expression or a statement.
+void find_calls(Node *node, Vector *calls) {
+    if (node->ty == ND_CALL)
+        vec_push(calls, node);
+    Vector *slots = children(node);
+    for (int i = 0; i < slots->len; i++)
+        find_calls(*(Node **)slots->data[i], calls);
+}
+
+void opt_report(void) {
+    for (int i = 0; i < NSTATS; i++)
+        fprintf(stderr, "opt: %s: %d\n", stat_names[i], stats[i]);
+}
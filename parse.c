@@ -11,13 +11,46 @@ size_t pos = 0;
 
 // Forward declaration.
 static void error(const char* msg, size_t i);
+static Node *labeled(int ty);
+static char *token_name(const Token *tok);
+static Node *named_label(void);
+static Node *label_address(void);
 
 // =============================================================================
 // Tokenization.
 // =============================================================================
 Map *globalvars = NULL;
+// Local variables visible in the current scope by their names in the source,
+// and all the local variables of the current function. A declaration reusing
+// the name of another local variable of the function is renamed, so that
+// later passes can tell variables apart by their names.
 static Map *localvars = NULL;
 
+// Struct types by tag.
+static Map *struct_tags = NULL;
+static Map *funcvars = NULL;
+
+// Case labels of the innermost switch statement, and the number of loops and
+// switch statements enclosing the current statement, which break may leave.
+static Vector *switch_cases = NULL;
+static int breakable = 0;
+
+// Named labels of the current function by name, and the positions of the
+// names used by goto statements and "&&", which must be defined by the end of
+// the function.
+static const char *cur_fname = NULL;
+static Map *func_labels = NULL;
+static Vector *label_uses = NULL;
+
+// Identifiers of the current function declared nowhere, and their positions.
+// Each must be the name of a function called, which turns it into a call.
+static Vector *unknown_idents = NULL;
+static Vector *unknown_pos = NULL;
+
+// Alignment by "_Alignas" in the last declaration specifiers, which applies
+// to the object of the following declarator.
+static size_t decl_align = 0;
+
 Node *new_node(int ty) {
     Node *node = calloc(1, sizeof(Node));
     node->ty = ty;
@@ -95,7 +128,6 @@ Node *new_node_num(int val) {
 }
 
 Node *new_node_string(const Token *tok) {
-#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
     Node *node = calloc(1, sizeof(Node));
     node->ty = ND_STRING;
 
@@ -112,7 +144,13 @@ Node *new_node_string(const Token *tok) {
     strncpy(buf, tok->input, tok->len);
     buf[tok->len] = '\0';
     node->name = buf;
-    map_put(strings, buf, (void *)strings->keys->len);
+
+    // Identical literals share a label.
+    if (!map_get(strings, buf)) {
+        char *label = malloc(16);
+        sprintf(label, ".LC%d", strings->keys->len);
+        map_put(strings, buf, label);
+    }
     return node;
 }
 
@@ -143,7 +181,10 @@ Node *new_node_ident(const Token *tok, Type *type) {
     Type *t = type;
     if (!t) {
         Node *n = (Node *)map_get(localvars, node->name);
-        if (n) t = n->type;
+        if (n) {
+            t = n->type;
+            node->name = n->name;
+        }
     }
     if (!t) {
         Node *n = (Node *)map_get(globalvars, node->name);
@@ -230,6 +271,18 @@ void tokenize(char *p) {
                 push_token(TK_STRUCT, p0, 0, len);
                 continue;
             }
+            if (strncmp(p0, "const", max(len, 5)) == 0) {
+                push_token(TK_CONST, p0, 0, len);
+                continue;
+            }
+            if (strncmp(p0, "_Alignas", max(len, 8)) == 0) {
+                push_token(TK_ALIGNAS, p0, 0, len);
+                continue;
+            }
+            if (strncmp(p0, "__attribute__", max(len, 13)) == 0) {
+                push_token(TK_ATTRIBUTE, p0, 0, len);
+                continue;
+            }
             if (strncmp(p0, "sizeof", max(len, 6)) == 0) {
                 push_token(TK_SIZEOF, p0, p, len);
                 continue;
@@ -254,10 +307,36 @@ void tokenize(char *p) {
                 push_token(TK_FOR, p0, 0, len);
                 continue;
             }
+            if (strncmp(p0, "switch", max(len, 6)) == 0) {
+                push_token(TK_SWITCH, p0, 0, len);
+                continue;
+            }
+            if (strncmp(p0, "case", max(len, 4)) == 0) {
+                push_token(TK_CASE, p0, 0, len);
+                continue;
+            }
+            if (strncmp(p0, "default", max(len, 7)) == 0) {
+                push_token(TK_DEFAULT, p0, 0, len);
+                continue;
+            }
+            if (strncmp(p0, "break", max(len, 5)) == 0) {
+                push_token(TK_BREAK, p0, 0, len);
+                continue;
+            }
+            if (strncmp(p0, "goto", max(len, 4)) == 0) {
+                push_token(TK_GOTO, p0, 0, len);
+                continue;
+            }
             push_token(TK_IDENT, p0, 0, len);
             continue;
         }
 
+        if (strncmp(p, "...", 3) == 0) {
+            push_token(TK_ELLIPSIS, p, 0, 3);
+            p += 3;
+            continue;
+        }
+
         // Logical or ("||") and and ("&&").
         if (strncmp(p, "||", 2) == 0) {
             push_token(TK_LOGICALOR, p, 0, 2);
@@ -325,6 +404,11 @@ void tokenize(char *p) {
             p += 2;
             continue;
         }
+        if (strncmp(p, "%=", 2) == 0) {
+            push_token(TK_ASSIGNMOD, p, 0, 2);
+            p += 2;
+            continue;
+        }
         if (strncmp(p, "|=", 2) == 0) {
             push_token(TK_ASSIGNOR, p, 0, 2);
             p += 2;
@@ -352,6 +436,8 @@ void tokenize(char *p) {
         case ',':
         case '-':
         case '/':
+        case '%':
+        case ':':
         case ';':
         case '<':
         case '=':
@@ -380,7 +466,11 @@ void tokenize(char *p) {
 // A buffer to store parsed statements (ASTs).
 Vector *funcdefs;
 
-// We will store string literals and their indices as we parse.
+// Functions declared or defined so far by name. A prototype is a function
+// definition without a body.
+Map *functions;
+
+// We will store string literals and their labels as we parse.
 Map *strings = NULL;
 
 // Private utility functions.
@@ -406,6 +496,12 @@ static void expect(int ty) {
     exit(1);
 }
 
+// Return true if a token starts a declaration.
+static bool is_decl_start(int ty) {
+    return ty == TK_TYPE_CHAR || ty == TK_TYPE_SHORT || ty == TK_TYPE_INT
+        || ty == TK_STRUCT || ty == TK_CONST || ty == TK_ALIGNAS;
+}
+
 // A function to report parsing errors.
 static void error(const char *msg, size_t i) {
     fprintf(stderr, "%s \"%s\"\n", msg, get_token(i)->input);
@@ -414,15 +510,23 @@ static void error(const char *msg, size_t i) {
 
 // Parse an expression to an abstract syntax tree.
 // program: {funcdef}* | declaration
-// funcdef: ident "(" parameter-list ")" compound
+// funcdef: type {"*"}* ident "(" parameter-list ")" (compound | ";")
+// parameter-list: '' | "void" | parameter {"," parameter}* {"," "..."}?
 // compound: "{" {declaration}* {statement}* "}"
-// declaration: "int" {"*"}* declarator
-// init_declarator: declarator | declarator "=" assign
-// declarator: ident | declarator "[" num "]"
-// statement: assign ";" | selection | iteration | "return" ";" | "return" assign ";"
+// declaration: {qualifier}* "int" {qualifier}* {"*" {"const"}?}* declarator
+// qualifier: "const" | "_Alignas" "(" num ")"
+// init_declarator: declarator | declarator "=" initializer
+// initializer: assign | string | "{" initializer {"," initializer}* {","}? "}"
+// declarator: ident {"[" {num}? "]"}* {attribute}*
+// attribute: "__attribute__" "(" "(" "aligned" {"(" num ")"}? ")" ")"
+// statement: assign ";" | selection | iteration | labeled | "break" ";"
+// statement: "goto" ident ";" | "goto" "*" assign ";"
+// statement: "return" ";" | "return" assign ";"
 // assign: logical_or assign'
 // assign': '' | "=" assign
 // selection: "if" "(" assign ")" statement | "if" "(" assign ")" statement "else" statement
+// selection: "switch" "(" assign ")" compound
+// labeled: "case" logical_or ":" | "default" ":" | ident ":" statement
 // iteration: "while" "(" assign ")" statement
 // iteration: "for" "(" assign ";" assign ";" assign ")" statement
 // logical_or: logical_and logical_or'
@@ -441,12 +545,82 @@ static void error(const char *msg, size_t i) {
 // relational': '' | "<" relational | ">" relational | "<=" relational | ">=" relational
 // add: mul add'
 // add': '' | "+" add' | "-" add'
-// mul: unary | unary "*" mul | unary "/" mul
-// unary: postfix | '++' unary | '--' unary | '*' unary | '&' unary
+// mul: unary | unary "*" mul | unary "/" mul | unary "%" mul
+// unary: postfix | '++' unary | '--' unary | '*' unary | '&' unary | '&&' ident
 // postfix: term | postfix "(" {assign}* ")" | postfix "[" assign "]" | postfix "." ident
 // term: num | "(" assign ")"
 
+static Type *type_specifier(void);
+
+// Parse an alignment, which must be a power of 2.
+static size_t alignment(void) {
+    Token *tok = get_token(pos);
+    if (!consume(TK_NUM) || tok->val <= 0 || (tok->val & (tok->val - 1)))
+        error("An alignment must be a power of 2.\n", pos);
+    return tok->val;
+}
+
+// Parse attributes and return the alignment given by them, or 0 if none.
+// "aligned" without a number gives the largest alignment of any type.
+static size_t attribute(void) {
+    size_t align = 0;
+    while (consume(TK_ATTRIBUTE)) {
+        expect('(');
+        expect('(');
+        Token *tok = get_token(pos);
+        if (tok->ty != TK_IDENT || strncmp(tok->input, "aligned", max(tok->len, 7)) != 0)
+            error("An unsupported attribute.\n", pos);
+        ++pos;
+        size_t n = 16;
+        if (consume('(')) {
+            n = alignment();
+            expect(')');
+        }
+        if (n > align)
+            align = n;
+        expect(')');
+        expect(')');
+    }
+    return align;
+}
+
+// Parse "const" and "_Alignas" around a type specifier.
+static void qualifiers(bool *is_const, size_t *align) {
+    for (;;) {
+        if (consume(TK_CONST)) {
+            *is_const = true;
+        } else if (consume(TK_ALIGNAS)) {
+            expect('(');
+            size_t n = alignment();
+            if (n > *align)
+                *align = n;
+            expect(')');
+        } else {
+            return;
+        }
+    }
+}
+
+// Parse a type specifier qualified by "const" before or after it. An
+// alignment by "_Alignas" is left to the declarator in decl_align.
 static Type *decl_specifier() {
+    bool is_const = false;
+    size_t align = 0;
+    qualifiers(&is_const, &align);
+    Type *type = type_specifier();
+    qualifiers(&is_const, &align);
+    // Members of a struct specifier have reset it.
+    decl_align = align;
+    if (!is_const)
+        return type;
+    // A struct type may be shared by its tag.
+    Type *qualified = malloc(sizeof(Type));
+    *qualified = *type;
+    qualified->is_const = true;
+    return qualified;
+}
+
+static Type *type_specifier(void) {
     Token *tok = get_token(pos++);
     if (tok->ty != TK_TYPE_CHAR
             && tok->ty != TK_TYPE_SHORT
@@ -468,14 +642,35 @@ static Type *decl_specifier() {
         break;
     case TK_STRUCT:
     {
+        // A tag without a member list refers to a struct defined earlier.
+        size_t align = attribute();
+        char *tag = NULL;
+        if (get_token(pos)->ty == TK_IDENT) {
+            Token *tag_tok = get_token(pos++);
+            tag = malloc(tag_tok->len + 1);
+            strncpy(tag, tag_tok->input, tag_tok->len);
+            tag[tag_tok->len] = '\0';
+            if (get_token(pos)->ty != '{') {
+                Type *tagged = (Type *)map_get(struct_tags, tag);
+                if (!tagged)
+                    error("An undefined struct tag.\n", pos - 1);
+                return tagged;
+            }
+        }
         type->ty = STRUCT;
         expect('{');
         type->member_types = new_map();
         type->member_offsets = new_map();
+        // Members may point to the struct itself.
+        if (tag)
+            map_put(struct_tags, tag, type);
         while (!consume('}')) {
             Node *member = struct_declaration(type);
             add_member(type, member->name, member->type);
         }
+        // An alignment of the struct also rounds its size up.
+        size_t attr_align = attribute();
+        type->align = attr_align > align ? attr_align : align;
         break;
     }
     }
@@ -490,12 +685,14 @@ static Type *type_name() {
 
 void program(void) {
     funcdefs = new_vector();
+    functions = new_map();
     globalvars = new_map();
+    struct_tags = new_map();
     strings = new_map();
     pos = 0;
     while (get_token(pos)->ty != TK_EOF) {
         Node *funcdef_or_globalvar = extern_declaration();
-        if (funcdef_or_globalvar->ty == ND_FUNCDEF)
+        if (funcdef_or_globalvar->ty == ND_FUNCDEF && funcdef_or_globalvar->fbody)
             vec_push(funcdefs, (void *)funcdef_or_globalvar);
     }
 }
@@ -507,35 +704,87 @@ Node *extern_declaration() {
     // token position, and simply parse again.
     size_t pos0 = pos;
 
-    // Parse till identifier and discard.
+    // Parse till identifier and discard. A struct may be declared alone.
     decl_specifier();
-    while(consume('*'))
+    if (consume(';'))
+        return new_node(ND_BLANK);
+    while(consume('*') || consume(TK_CONST))
         ;   // NOP.
     if (get_token(pos)->ty != TK_IDENT)
         error("A function definition expected but not found.\n", pos);
     ++pos;
     Token *tok_after_ident = get_token(pos);
 
-    // Reset token position and parse again.
+    // Reset token position and parse again. A global initializer sees no
+    // local variables.
     pos = pos0;
+    localvars = new_map();
+    funcvars = new_map();
     if (tok_after_ident->ty == '(')
         return funcdef();
     else
         return declaration(globalvars);
 }
 
+// Wrap a type in a pointer for each '*', which may be qualified by "const".
+static Type *pointer(Type *type) {
+    while (consume('*')) {
+        Type *inner = type;
+        type = calloc(1, sizeof(Type));
+        type->ty = PTR;
+        type->ptr_of = inner;
+        type->is_const = consume(TK_CONST);
+    }
+    return type;
+}
+
 static Node *parse_func_param() {
-    if (get_token(pos)->ty != TK_TYPE_INT)
+    if (!is_decl_start(get_token(pos)->ty))
         error("Missing type specifier for a function parameter.\n", pos);
-    Type *type = decl_specifier();
-    Node *node = new_node_ident(get_token(pos++), type);
+    Type *type = pointer(decl_specifier());
+
+    // A parameter of a prototype may be unnamed.
+    if (get_token(pos)->ty != TK_IDENT) {
+        Node *node = new_node(ND_IDENT);
+        node->type = type;
+        return node;
+    }
+    Node *node = declarator(type);
+    if (node->type->ty == ARRAY)
+        error("An array parameter is not supported.\n", pos);
     map_put(localvars, node->name, node);
+    map_put(funcvars, node->name, node);
     return node;
 }
 
+// Check a declaration of a function against an earlier one.
+static void check_redeclaration(const Node *func, size_t pos0) {
+    const Node *prev = map_get(functions, func->fname);
+    if (!prev)
+        return;
+    if (prev->fbody && func->fbody)
+        error("Redefinition of a function.\n", pos0);
+    // Parameters declared with "()" agree with any.
+    bool any = prev->unspecified || func->unspecified;
+    bool same = (any || prev->variadic == func->variadic)
+        && (any || prev->fargs->len == func->fargs->len)
+        && get_typesize(prev->type) == get_typesize(func->type)
+        && prev->type->ty == func->type->ty;
+    for (int i = 0; same && !any && i < func->fargs->len; i++) {
+        const Type *a = ((Node *)prev->fargs->data[i])->type;
+        const Type *b = ((Node *)func->fargs->data[i])->type;
+        same = a->ty == b->ty && get_typesize(a) == get_typesize(b);
+    }
+    if (!same)
+        error("Conflicting types for a function.\n", pos0);
+}
+
+// Parse a function definition or a prototype.
 Node *funcdef(void) {
-    if (!consume(TK_TYPE_INT))
+    size_t pos0 = pos;
+    if (!is_decl_start(get_token(pos)->ty))
         error("Missing return type of a function definition.\n", pos);
+    Type *ret = pointer(decl_specifier());
 
     Token *tok = get_token(pos);
     if (tok->ty != TK_IDENT)
@@ -544,32 +793,464 @@ Node *funcdef(void) {
 
     // Prepare a new set of local variables.
     localvars = new_map();
+    funcvars = new_map();
+    func_labels = new_map();
+    label_uses = new_vector();
+    unknown_idents = new_vector();
+    unknown_pos = new_vector();
     Node *func = new_funcdef(tok);
+    cur_fname = func->fname;
+    func->type = ret;
 
     if (!consume('('))
         error("'(' expected but not found.\n", pos);
-    if (!consume(')')) {
-        vec_push(func->fargs, parse_func_param());
-        while (consume(',')) {
+    Token *first = get_token(pos);
+    if (first->ty == TK_IDENT && first->len == 4 && strncmp(first->input, "void", 4) == 0
+            && get_token(pos + 1)->ty == ')') {
+        // No parameters.
+        pos += 2;
+    } else if (get_token(pos)->ty == ')') {
+        ++pos;
+        func->unspecified = true;
+    } else {
+        do {
+            if (consume(TK_ELLIPSIS)) {
+                func->variadic = true;
+                break;
+            }
             vec_push(func->fargs, parse_func_param());
-        }
+        } while (consume(','));
         expect(')');
     }
 
+    if (consume(';')) {
+        check_redeclaration(func, pos0);
+        const Node *prev = map_get(functions, func->fname);
+        if (!prev || (prev->unspecified && !func->unspecified))
+            map_put(functions, func->fname, func);
+        cur_fname = NULL;
+        return func;
+    }
+
+    if (func->variadic)
+        error("A variadic function definition is not supported.\n", pos0);
+    for (int i = 0; i < func->fargs->len; i++)
+        if (!((Node *)func->fargs->data[i])->name)
+            error("A parameter name is missing in a function definition.\n", pos0);
+    // A definition has exactly the parameters it names.
+    func->unspecified = false;
+    check_redeclaration(func, pos0);
+    map_put(functions, func->fname, func);
     func->fbody = compound();
+    for (int i = 0; i < label_uses->len; i++) {
+        size_t use = (size_t)label_uses->data[i];
+        if (!map_get(func_labels, token_name(get_token(use))))
+            error("A label used but not defined in the function.\n", use);
+    }
+    for (int i = 0; i < unknown_idents->len; i++)
+        if (((Node *)unknown_idents->data[i])->ty == ND_IDENT)
+            error("An unknown identifier.\n", (size_t)unknown_pos->data[i]);
+    cur_fname = NULL;
     return func;
 }
 
+// Return true if a global variable, which is not shadowed by a local one, is
+// named so.
+static bool is_global(const char *name) {
+    return map_get(globalvars, name) && !map_get(funcvars, name);
+}
+
+// Evaluate the address of an lvalue of a global variable.
+static bool eval_const_addr(const Node *lval, char **sym, int *val) {
+    switch (lval->ty) {
+    case ND_IDENT:
+        if (!is_global(lval->name))
+            return false;
+        *sym = lval->name;
+        *val = 0;
+        return true;
+    case ND_MEMBER:
+        if (!eval_const_addr(lval->member_of, sym, val))
+            return false;
+        *val += (int)get_member_offset(lval->member_of->type, lval->mname);
+        return true;
+    case ND_UEXPR:
+        return lval->uop == '*' && eval_const(lval->operand, sym, val);
+    default:
+        return false;
+    }
+}
+
+// Evaluate a constant expression, which is a number, or an address of a
+// global variable, a string literal, or a label plus a number. sym is set to the
+// symbol of the address, or NULL for a number. Return false if the
+// expression is not constant.
+bool eval_const(const Node *node, char **sym, int *val) {
+#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
+    switch (node->ty) {
+    case ND_NUM:
+        *sym = NULL;
+        *val = node->val;
+        return true;
+    case ND_STRING:
+        *sym = (char *)map_get(strings, node->name);
+        *val = 0;
+        return true;
+    case ND_LABELADDR:
+        *sym = node->name;
+        *val = 0;
+        return true;
+    case ND_IDENT:
+        // An array is converted to its address.
+        return node->type && node->type->ty == ARRAY && eval_const_addr(node, sym, val);
+    case ND_UEXPR:
+        return node->uop == '&' && eval_const_addr(node->operand, sym, val);
+    case '+':
+    case '-':
+    {
+        char *lsym, *rsym;
+        int lhs, rhs;
+        if (!eval_const(node->lhs, &lsym, &lhs) || !eval_const(node->rhs, &rsym, &rhs))
+            return false;
+        if ((lsym && rsym) || (rsym && node->ty == '-'))
+            return false;
+        // A number added to an address is scaled by the size pointed to.
+        // The arithmetic wraps around as it does at run time.
+        unsigned l = (unsigned)lhs, r = (unsigned)rhs;
+        if (lsym)
+            r *= (unsigned)get_typesize(node->lhs->type->ptr_of);
+        if (rsym)
+            l *= (unsigned)get_typesize(node->rhs->type->ptr_of);
+        *sym = lsym ? lsym : rsym;
+        *val = (int)(node->ty == '+' ? l + r : l - r);
+        return true;
+    }
+    case '*':
+    case '/':
+    case '%':
+    case '&':
+    case '|':
+    case '^':
+    {
+        char *lsym, *rsym;
+        int lhs, rhs;
+        if (!eval_const(node->lhs, &lsym, &lhs) || !eval_const(node->rhs, &rsym, &rhs)
+                || lsym || rsym)
+            return false;
+        if ((node->ty == '/' || node->ty == '%') && rhs == 0)
+            return false;
+        *sym = NULL;
+        // Fold in long long, whose range holds every result, and truncate
+        // to int as the generated code does.
+        long long l = lhs, r = rhs;
+        long long v = node->ty == '*' ? l * r : node->ty == '/' ? l / r
+            : node->ty == '%' ? l % r : node->ty == '&' ? (l & r)
+            : node->ty == '|' ? (l | r) : (l ^ r);
+        *val = (int)(unsigned)v;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// Initializers.
+//
+// An initializer of an array or a struct is parsed into Init elements of
+// scalars, pointers, and structs given by expressions, each at an offset in
+// the variable. The parts not given are zero. Braces may be omitted around
+// an inner array or struct, whose elements or members are then taken in
+// order until it is full.
+static Node *copy_lval(const Node *lval) {
+    Node *copy = malloc(sizeof(Node));
+    *copy = *lval;
+    switch (lval->ty) {
+    case ND_MEMBER:
+        copy->member_of = copy_lval(lval->member_of);
+        break;
+    case ND_UEXPR:
+        copy->operand = copy_lval(lval->operand);
+        break;
+    case '+':
+        copy->lhs = copy_lval(lval->lhs);
+        copy->rhs = copy_lval(lval->rhs);
+        break;
+    }
+    return copy;
+}
+
+static void add_init(Vector *inits, Type *type, size_t offset, const Node *lval, Node *value) {
+    Init *init = malloc(sizeof(Init));
+    *init = (Init) { .offset = offset, .type = type, .lval = copy_lval(lval), .value = value };
+    vec_push(inits, init);
+}
+
+static Node *element_lval(Node *lval, int i) {
+    return new_node_uop('*', new_node_binop('+', lval, new_node_num(i)));
+}
+
+// Decode the escape sequences of a string literal into a buffer. Return the
+// length.
+static int decode_string(const char *p, int len, char *buf) {
+    static const char escapes[] = "a\ab\bf\fn\nr\rt\tv\v";
+    const char *end = p + len;
+    int n = 0;
+    while (p < end) {
+        if (*p != '\\') {
+            buf[n++] = *p++;
+            continue;
+        }
+        p++;
+        if ('0' <= *p && *p <= '7') {
+            int c = 0;
+            for (int i = 0; i < 3 && '0' <= *p && *p <= '7'; i++)
+                c = c * 8 + *p++ - '0';
+            buf[n++] = (char)c;
+            continue;
+        }
+        if (*p == 'x' && p + 1 < end && isxdigit((unsigned char)p[1])) {
+            int c = 0;
+            for (p++; p < end && isxdigit((unsigned char)*p); p++)
+                c = (c * 16 + (isdigit((unsigned char)*p) ? *p - '0' : tolower(*p) - 'a' + 10)) & 0xff;
+            buf[n++] = (char)c;
+            continue;
+        }
+        const char *e = strchr(escapes, *p);
+        buf[n++] = e && (e - escapes) % 2 == 0 ? e[1] : *p;
+        p++;
+    }
+    return n;
+}
+
+// Initialize a char array with a string literal. Return the length of the
+// string including the terminating null.
+static int string_initializer(Type *type, size_t offset, Node *lval, Vector *inits) {
+    Token *tok = get_token(pos++);
+    char *buf = malloc(tok->len + 1);
+    int len = decode_string(tok->input, tok->len, buf) + 1;
+    buf[len - 1] = '\0';
+    for (int i = 0; i < len && (type->array_len == 0 || i < (int)type->array_len); i++)
+        add_init(inits, type->ptr_of, offset + i, element_lval(lval, i), new_node_num((unsigned char)buf[i]));
+    return len;
+}
+
+static int initializer(Type *type, size_t offset, Node *lval, Vector *inits);
+
+// Initialize the elements of an array or the members of a struct in order.
+// Without braces, they are taken until the aggregate is full. Return the
+// number of them initialized.
+static int aggregate_initializer(Type *type, size_t offset, Node *lval, Vector *inits, bool braced) {
+    int len = type->ty == ARRAY ? (int)type->array_len : type->member_types->keys->len;
+    // An array of an unknown length takes all the elements given.
+    bool unbounded = type->ty == ARRAY && len == 0;
+    int n = 0;
+    while (get_token(pos)->ty != '}') {
+        if (!unbounded && n == len) {
+            if (braced)
+                error("Excess elements in an initializer.\n", pos);
+            break;
+        }
+        if (type->ty == ARRAY) {
+            Type *elem = type->ptr_of;
+            initializer(elem, offset + n * get_typesize(elem), element_lval(lval, n), inits);
+        } else {
+            char *name = (char *)type->member_types->keys->data[n];
+            Node *member = new_node(ND_MEMBER);
+            member->member_of = lval;
+            member->mname = name;
+            member->type = (Type *)type->member_types->vals->data[n];
+            initializer(member->type, offset + get_member_offset(type, name), member, inits);
+        }
+        n++;
+        if ((!braced && n == len) || !consume(','))
+            break;
+    }
+    return n;
+}
+
+// Parse an initializer of the part of a variable of a type at an offset.
+// Return the number of elements initialized if it is an array.
+static int initializer(Type *type, size_t offset, Node *lval, Vector *inits) {
+    // A char array may be initialized with a string literal in braces or not.
+    if (type->ty == ARRAY && type->ptr_of->ty == CHAR) {
+        if (get_token(pos)->ty == TK_STRING_LITERAL)
+            return string_initializer(type, offset, lval, inits);
+        if (get_token(pos)->ty == '{' && get_token(pos + 1)->ty == TK_STRING_LITERAL) {
+            ++pos;
+            int n = string_initializer(type, offset, lval, inits);
+            expect('}');
+            return n;
+        }
+    }
+
+    if (consume('{')) {
+        if (type->ty == ARRAY || type->ty == STRUCT) {
+            int n = aggregate_initializer(type, offset, lval, inits, true);
+            expect('}');
+            return n;
+        }
+        // A scalar may be in braces, which may be empty.
+        if (consume('}'))
+            return 0;
+        initializer(type, offset, lval, inits);
+        consume(',');
+        expect('}');
+        return 1;
+    }
+
+    if (type->ty == ARRAY || type->ty == STRUCT) {
+        // A struct may be given by an expression of the type. Otherwise, the
+        // braces are omitted.
+        size_t pos0 = pos;
+        if (type->ty == STRUCT) {
+            Node *value = assign();
+            if (value->type && value->type->member_types == type->member_types) {
+                add_init(inits, type, offset, lval, value);
+                return 1;
+            }
+            pos = pos0;
+        }
+        return aggregate_initializer(type, offset, lval, inits, false);
+    }
+
+    add_init(inits, type, offset, lval, assign());
+    return 1;
+}
+
+// Parse the initializer of a declaration. A scalar, or a struct given by an
+// expression, is initialized with declinit. An array or a struct given by an
+// initializer list is initialized with inits.
+static void parse_initializer(Node *decl) {
+    Type *type = decl->type;
+    bool aggregate = type->ty == ARRAY || (type->ty == STRUCT && get_token(pos)->ty == '{');
+    if (!aggregate && get_token(pos)->ty != '{') {
+        decl->declinit = assign();
+        return;
+    }
+
+    Node *lval = new_node(ND_IDENT);
+    lval->name = decl->name;
+    lval->type = type;
+    decl->inits = new_vector();
+    int n = initializer(type, 0, lval, decl->inits);
+    if (type->ty == ARRAY && type->array_len == 0)
+        type->array_len = n;
+    if (!aggregate) {
+        // A scalar in braces.
+        decl->declinit = n ? ((Init *)decl->inits->data[0])->value : new_node_num(0);
+        decl->inits = NULL;
+    }
+}
+
+static void check_array_len(const Node *decl, size_t pos0) {
+    if (decl->type->ty == ARRAY && decl->type->array_len == 0)
+        error("An array length is missing.\n", pos0);
+}
+
 Node *declaration(Map *variables) {
     // Read type before identifier, e.g., "int **".
     Type *type = decl_specifier();
     // Declarator after identifier may alter the type.
+    size_t pos0 = pos;
     Node *node = init_declarator(type);
+    check_array_len(node, pos0);
+
+    // A global variable is initialized with constants.
+    char *sym;
+    int val;
+    if (node->declinit && !eval_const(node->declinit, &sym, &val))
+        error("An initializer element is not constant.\n", pos0);
+    for (int i = 0; node->inits && i < node->inits->len; i++)
+        if (!eval_const(((Init *)node->inits->data[i])->value, &sym, &val))
+            error("An initializer element is not constant.\n", pos0);
     map_put(variables, node->name, node);
     expect(';');
     return node;
 }
 
+// Make a read-only image of the constant elements of an initializer, which is
+// emitted as a global variable.
+static Node *new_image(Type *type, Vector *inits) {
+    static int nimages = 0;
+    Node *image = new_node(ND_DECLARATION);
+    image->name = malloc(16);
+    sprintf(image->name, ".LI%d", nimages++);
+    image->type = malloc(sizeof(Type));
+    *image->type = *type;
+    image->type->is_const = true;
+    image->inits = inits;
+    map_put(globalvars, image->name, image);
+    return image;
+}
+
+// Parse a declaration of a local variable into code. The constant elements
+// of an initializer list are copied from an image in .rodata, or the
+// variable refers to the image itself if it is const and fully constant. The
+// parts not given are zeroed, and the other elements are stored one by one
+// after the declaration.
+static void local_declaration(Vector *code) {
+    Type *type = decl_specifier();
+    if (consume(';'))
+        return;
+    size_t pos0 = pos;
+    Node *decl = declarator(type);
+    Node *node = new_node_declaration(decl, decl->type, NULL);
+    char *name = node->name;
+    if (map_get(funcvars, name)) {
+        node->name = malloc(strlen(name) + 16);
+        sprintf(node->name, "%s.s%d", name, funcvars->keys->len);
+    }
+    if (consume('='))
+        parse_initializer(node);
+    check_array_len(node, pos0);
+    expect(';');
+
+    Vector *consts = new_vector();
+    Vector *stores = new_vector();
+    bool nonzero = false;
+    size_t covered = 0;
+    for (int i = 0; node->inits && i < node->inits->len; i++) {
+        Init *init = (Init *)node->inits->data[i];
+        char *sym;
+        int val;
+        if (eval_const(init->value, &sym, &val)) {
+            vec_push(consts, init);
+            nonzero |= sym || val;
+        } else {
+            vec_push(stores, init);
+        }
+        covered += get_typesize(init->type);
+    }
+    if (node->inits && nonzero) {
+        Node *image = new_image(node->type, consts);
+        if (is_readonly(node->type) && stores->len == 0) {
+            map_put(localvars, name, image);
+            return;
+        }
+        node->declinit = new_node(ND_IDENT);
+        node->declinit->name = image->name;
+        node->declinit->type = image->type;
+    } else if (node->inits) {
+        node->zeroinit = covered < get_typesize(node->type);
+    }
+    node->inits = NULL;
+
+    map_put(localvars, name, node);
+    map_put(funcvars, node->name, node);
+    vec_push(code, node);
+    for (int i = 0; i < stores->len; i++) {
+        Init *init = (Init *)stores->data[i];
+        vec_push(code, new_node_binop('=', init->lval, init->value));
+    }
+}
+
+static Map *copy_map(const Map *map) {
+    Map *copy = new_map();
+    for (int i = 0; i < map->keys->len; i++)
+        map_put(copy, map->keys->data[i], map->vals->data[i]);
+    return copy;
+}
+
 Node *struct_declaration() {
     // Read type before identifier, e.g., "int **".
     Type *type = decl_specifier();
@@ -581,22 +1262,15 @@ Node *struct_declaration() {
 
 Node *init_declarator(Type *type) {
     Node *decl = declarator(type);
-    Node *init = NULL;
-    if (consume('=')) {
-        init = assign();
-    }
-    Node *node = new_node_declaration(decl, decl->type, init);
+    Node *node = new_node_declaration(decl, decl->type, NULL);
+    if (consume('='))
+        parse_initializer(node);
     return node;
 }
 
 Node *declarator(Type *type) {
     // If '*'s are found, make a pointer of a type.
-    while (consume('*')) {
-        Type *inner = type;
-        type = calloc(1, sizeof(Type));
-        type->ty = PTR;
-        type->ptr_of = inner;
-    }
+    type = pointer(type);
 
     if (type->ty == ARRAY)
         error("Recursive declarator. Not implemented yet.\n", pos);
@@ -605,20 +1279,41 @@ Node *declarator(Type *type) {
 
     Node *node = new_node_ident(get_token(pos++), type);
 
-    if (consume('[')) {
-        // Array declaration. Parse and set an array type.
-        Token *tok = get_token(pos++);
-        if (tok->ty != TK_NUM)
-            error("Array length must be specified with an integer literal.\n", pos);
+    // Array declaration. Parse the lengths, of which the first may be left
+    // to an initializer, and wrap the type from the last one.
+    Vector *lens = new_vector();
+    while (consume('[')) {
+        Token *tok = get_token(pos);
+        if (tok->ty == ']' && lens->len == 0) {
+            vec_push(lens, (void *)0);
+        } else {
+            ++pos;
+            if (tok->ty != TK_NUM)
+                error("Array length must be specified with an integer literal.\n", pos);
+            vec_push(lens, (void *)(size_t)tok->val);
+        }
         expect(']');
-
+    }
+    for (int i = lens->len - 1; i >= 0; i--) {
         Type *artype = calloc(1, sizeof(Type));
         artype->ty = ARRAY;
         artype->ptr_of = type;
-        artype->array_len = tok->val;
+        artype->array_len = (size_t)lens->data[i];
+        type = artype;
+    }
 
-        node->type = artype;
+    // The object may be aligned more strictly than its type.
+    size_t align = attribute();
+    if (decl_align > align)
+        align = decl_align;
+    decl_align = 0;
+    if (align > get_typealign(type)) {
+        Type *aligned = malloc(sizeof(Type));
+        *aligned = *type;
+        aligned->align = align;
+        type = aligned;
     }
+    node->type = type;
 
     return node;
 }
@@ -627,18 +1322,16 @@ Node *compound(void) {
     if (!consume('{'))
         error("'{' expected but not found.\n", pos);
     
+    // Declarations in the block are visible until its end.
+    Map *outer = localvars;
+    localvars = copy_map(outer);
     Vector *code = new_vector();
     Token *tok = get_token(pos);
     while (tok->ty != TK_EOF && tok->ty != '}') {
-        Node *decl_or_stmt = NULL;
-        if (tok->ty == TK_TYPE_CHAR
-                || tok->ty == TK_TYPE_SHORT
-                || tok->ty == TK_TYPE_INT
-                || tok->ty == TK_STRUCT)
-            decl_or_stmt = declaration(localvars);
+        if (is_decl_start(tok->ty))
+            local_declaration(code);
         else
-            decl_or_stmt = statement();
-        vec_push(code, (void *)decl_or_stmt);
+            vec_push(code, (void *)statement());
         tok = get_token(pos);
     }
     if (!consume('}'))
@@ -647,6 +1340,7 @@ Node *compound(void) {
     Node *comp_stmt = new_node(ND_COMPOUND);
     comp_stmt->stmts = code;
     comp_stmt->localvars = localvars;
+    localvars = outer;
     return comp_stmt;
 }
 
@@ -674,6 +1368,38 @@ Node *statement(void) {
         ++pos;
         node = iteration_for();
         return node;
+    case TK_SWITCH:
+        ++pos;
+        node = selection_switch();
+        return node;
+    case TK_CASE:
+    case TK_DEFAULT:
+        ++pos;
+        node = labeled(tok->ty);
+        return node;
+    case TK_BREAK:
+        ++pos;
+        if (breakable == 0)
+            error("A break statement not within a loop or a switch statement.\n", pos - 1);
+        node = new_node(ND_BREAK);
+        break;
+    case TK_GOTO:
+        ++pos;
+        node = new_node(ND_GOTO);
+        if (consume('*')) {
+            // Computed goto to an address taken by "&&".
+            node->rhs = assign();
+            if (!node->rhs->type || node->rhs->type->ty != PTR)
+                error("The operand of a computed goto must be a pointer.\n", pos - 1);
+        } else {
+            node->rhs = label_address();
+        }
+        break;
+    case TK_IDENT:
+        if (get_token(pos + 1)->ty == ':')
+            return named_label();
+        node = assign();
+        break;
 
     case TK_RETURN:
         ++pos;
@@ -713,6 +1439,8 @@ Node *assign(void) {
         return reassign_to_lhs('*', lhs, assign());
     if (consume(TK_ASSIGNDIVIDE))
         return reassign_to_lhs('/', lhs, assign());
+    if (consume(TK_ASSIGNMOD))
+        return reassign_to_lhs('%', lhs, assign());
     if (consume(TK_ASSIGNOR))
         return reassign_to_lhs('|', lhs, assign());
     if (consume(TK_ASSIGNXOR))
@@ -734,12 +1462,136 @@ Node *selection(void) {
     return node;
 }
 
+static char *token_name(const Token *tok) {
+    char *name = malloc(tok->len + 1);
+    strncpy(name, tok->input, tok->len);
+    name[tok->len] = '\0';
+    return name;
+}
+
+// Name of the assembly symbol of a named label, which is local to the
+// function.
+static char *label_symbol(const char *name) {
+    char *sym = malloc(strlen(cur_fname) + strlen(name) + 4);
+    sprintf(sym, ".L%s.%s", cur_fname, name);
+    return sym;
+}
+
+// Parse a named label and the statement it labels into a block.
+static Node *named_label(void) {
+    Token *tok = get_token(pos);
+    pos += 2;
+    char *name = token_name(tok);
+    if (map_get(func_labels, name))
+        error("A duplicate label in a function.\n", pos - 2);
+    Node *label = new_node(ND_LABEL);
+    label->name = label_symbol(name);
+    map_put(func_labels, name, label);
+
+    Node *node = new_node(ND_COMPOUND);
+    node->stmts = new_vector();
+    node->localvars = localvars;
+    vec_push(node->stmts, label);
+    vec_push(node->stmts, statement());
+    return node;
+}
+
+// Parse the name of a label, which may be defined later in the function, into
+// its address.
+static Node *label_address(void) {
+    Token *tok = get_token(pos);
+    if (tok->ty != TK_IDENT)
+        error("A label name expected but not found.\n", pos);
+    vec_push(label_uses, (void *)pos);
+    ++pos;
+
+    Node *node = new_node(ND_LABELADDR);
+    node->name = label_symbol(token_name(tok));
+    node->type = calloc(1, sizeof(Type));
+    node->type->ty = PTR;
+    node->type->ptr_of = calloc(1, sizeof(Type));
+    node->type->ptr_of->ty = CHAR;
+    return node;
+}
+
+// Parse a case or default label. The statement it labels follows it in the
+// body of the switch statement.
+static Node *labeled(int ty) {
+    size_t pos0 = pos - 1;
+    if (!switch_cases)
+        error("A label not within a switch statement.\n", pos0);
+    Node *node = new_node(ty == TK_CASE ? ND_CASE : ND_DEFAULT);
+    if (ty == TK_CASE) {
+        char *sym;
+        if (!eval_const(logical_or(), &sym, &node->val) || sym)
+            error("A case label must be an integer constant.\n", pos0);
+    }
+    expect(':');
+    for (int i = 0; i < switch_cases->len; i++) {
+        const Node *other = (Node *)switch_cases->data[i];
+        if (other->ty == node->ty && (ty == TK_DEFAULT || other->val == node->val))
+            error("A duplicate label in a switch statement.\n", pos0);
+    }
+    vec_push(switch_cases, node);
+    return node;
+}
+
+// Return true if a statement has a label of the switch statement it is in.
+static bool has_label(const Node *node) {
+    switch (node->ty) {
+    case ND_CASE:
+    case ND_DEFAULT:
+        return true;
+    case ND_COMPOUND:
+        for (int i = 0; i < node->stmts->len; i++)
+            if (has_label(node->stmts->data[i]))
+                return true;
+        return false;
+    case ND_IF:
+        return has_label(node->then) || (node->els && has_label(node->els));
+    case ND_WHILE:
+    case ND_FOR:
+        return has_label(node->iterbody);
+    default:
+        return false;
+    }
+}
+
+// The labels must be in the body itself, not in statements in it, so that
+// the body is a sequence of statements entered at the labels.
+Node *selection_switch(void) {
+    size_t pos0 = pos - 1;
+    Node *node = new_node(ND_SWITCH);
+    expect('(');
+    node->cond = assign();
+    expect(')');
+    if (get_token(pos)->ty != '{')
+        error("The body of a switch statement must be a compound statement.\n", pos);
+
+    Vector *outer = switch_cases;
+    switch_cases = new_vector();
+    ++breakable;
+    node->then = compound();
+    --breakable;
+    switch_cases = outer;
+
+    Vector *stmts = node->then->stmts;
+    for (int i = 0; i < stmts->len; i++) {
+        const Node *stmt = (Node *)stmts->data[i];
+        if (stmt->ty != ND_CASE && stmt->ty != ND_DEFAULT && has_label(stmt))
+            error("A label nested in a statement in a switch statement is not supported.\n", pos0);
+    }
+    return node;
+}
+
 Node *iteration_while(void) {
     Node *node = new_node(ND_WHILE);
     expect('(');
     node->itercond = assign();
     expect(')');
+    ++breakable;
     node->iterbody = statement();
+    --breakable;
     return node;
 }
 
@@ -761,7 +1613,9 @@ Node *iteration_for(void) {
     else
         node->step = new_node(ND_BLANK);
     expect(')');
+    ++breakable;
     node->iterbody = statement();
+    --breakable;
     return node;
 }
 
@@ -848,6 +1702,9 @@ Node *mul(void) {
     case '/':
         ++pos;
         return new_node_binop('/', lhs, mul());
+    case '%':
+        ++pos;
+        return new_node_binop('%', lhs, mul());
     default:
         return lhs;
     }
@@ -878,8 +1735,17 @@ Node *unary(void) {
     {
         ++pos;
         Node *operand = unary();
+        // A negative literal is a constant rather than an expression.
+        if (tok->ty == '-' && operand->ty == ND_NUM)
+            return new_node_num((int)(0u - (unsigned)operand->val));
         return new_node_uop(tok->ty, operand);
     }
+    case TK_LOGICALAND:
+        // Address of a label.
+        ++pos;
+        if (!cur_fname)
+            error("A label address outside a function.\n", pos - 1);
+        return label_address();
     case TK_SIZEOF:
     {
         ++pos;
@@ -904,22 +1770,30 @@ Node *postfix(void) {
         node->ty = ND_CALL;
         node->fargs = new_vector();
 
-        // Set return type.
-        // For now, we assume all functions return an int.
-        node->type = calloc(1, sizeof(Type));
-        node->type->ty = INT;
-        node->type->ptr_of = NULL;
-
-        // Nullary function call.
-        if (consume(')'))
-            return node;
+        // Take the return type from the declaration. A function not
+        // declared yet returns an int and may be variadic.
+        const Node *sig = map_get(functions, node->name);
+        if (sig) {
+            node->type = sig->type;
+            node->variadic = sig->variadic || sig->unspecified;
+        } else {
+            node->type = calloc(1, sizeof(Type));
+            node->type->ty = INT;
+            node->type->ptr_of = NULL;
+            node->variadic = true;
+        }
 
         // List arguments.
-        vec_push(node->fargs, assign());
-        while (consume(','))
+        if (!consume(')')) {
             vec_push(node->fargs, assign());
-        if (!consume(')'))
-            error("No closing parenthesis ')' for function call.", pos);
+            while (consume(','))
+                vec_push(node->fargs, assign());
+            if (!consume(')'))
+                error("No closing parenthesis ')' for function call.", pos);
+        }
+        if (sig && !sig->unspecified && (node->fargs->len < sig->fargs->len
+                    || (!sig->variadic && node->fargs->len > sig->fargs->len)))
+            error("Wrong number of arguments in a function call.\n", pos - 1);
         break;
 
     case '[':
@@ -973,8 +1847,15 @@ Node *postfix(void) {
 Node *term(void) {
     if (get_token(pos)->ty == TK_NUM)
         return new_node_num(get_token(pos++)->val);
-    if (get_token(pos)->ty == TK_IDENT)
-        return new_node_ident(get_token(pos++), NULL);
+    if (get_token(pos)->ty == TK_IDENT) {
+        Node *node = new_node_ident(get_token(pos), NULL);
+        if (!node->type && cur_fname) {
+            vec_push(unknown_idents, node);
+            vec_push(unknown_pos, (void *)pos);
+        }
+        ++pos;
+        return node;
+    }
     if (get_token(pos)->ty == TK_STRING_LITERAL)
         return new_node_string(get_token(pos++));
 
@@ -0,0 +1,712 @@
+#include <assert.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "cc.h"
+
+// Instructions of the function being generated.
+static Vector *insns = NULL;
+
+// =============================================================================
+// Instruction list.
+// =============================================================================
+static char *trim(char *s) {
+    while (isspace(*s))
+        s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace(end[-1]))
+        *--end = '\0';
+    return s;
+}
+
+static char *copy_string(const char *s) {
+    char *buf = malloc(strlen(s) + 1);
+    strcpy(buf, s);
+    return buf;
+}
+
+static Insn *new_insn(int kind, const char *op) {
+    Insn *insn = calloc(1, sizeof(Insn));
+    insn->kind = kind;
+    insn->op = copy_string(op);
+    return insn;
+}
+
+// Parse a line of assembly into an instruction. Lines are the same as those
+// printed, e.g., "  mov rax, 3\n" or ".L3:\n".
+Insn *parse_insn(const char *text) {
+    char *line = trim(copy_string(text));
+    size_t len = strlen(line);
+    if (len > 0 && line[len-1] == ':') {
+        line[len-1] = '\0';
+        return new_insn(IN_LABEL, line);
+    }
+
+    char *args = line;
+    while (*args && !isspace(*args))
+        args++;
+    if (*args)
+        *args++ = '\0';
+    args = trim(args);
+
+    // Directive operands are kept as they are.
+    if (line[0] == '.') {
+        Insn *insn = new_insn(IN_DIRECTIVE, line);
+        if (*args) {
+            insn->args[0] = copy_string(args);
+            insn->nargs = 1;
+        }
+        return insn;
+    }
+
+    Insn *insn = new_insn(IN_OP, line);
+    while (*args) {
+        assert(insn->nargs < 3);
+        char *comma = strchr(args, ',');
+        if (comma)
+            *comma = '\0';
+        insn->args[insn->nargs++] = copy_string(trim(args));
+        if (!comma)
+            break;
+        args = comma + 1;
+    }
+    return insn;
+}
+
+// Append a line of assembly to the instruction list of the current function.
+// The format is that of printf.
+void emit(const char *fmt, ...) {
+    if (!insns)
+        insns = new_vector();
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    vec_push(insns, parse_insn(buf));
+}
+
+static void print_insn(const Insn *insn) {
+    if (insn->kind == IN_DELETED)
+        return;
+    if (insn->kind == IN_LABEL) {
+        printf("%s:\n", insn->op);
+        return;
+    }
+    printf("  %s", insn->op);
+    for (int i = 0; i < insn->nargs; i++)
+        printf("%s%s", i == 0 ? " " : ", ", insn->args[i]);
+    printf("\n");
+}
+
+// Optimize and print the instructions emitted so far.
+void emit_flush(void) {
+    if (!insns)
+        return;
+    peephole(insns);
+    for (int i = 0; i < insns->len; i++)
+        print_insn(insns->data[i]);
+    insns = NULL;
+}
+
+void emit_discard(void) {
+    insns = NULL;
+}
+
+
+// =============================================================================
+// Registers used by instructions.
+// =============================================================================
+// Registers are identified by their 64-bit names.
+static const char *reg_names[][5] = {
+    { "rax", "eax", "ax", "al", NULL },
+    { "rbx", "ebx", "bx", "bl", NULL },
+    { "rcx", "ecx", "cx", "cl", NULL },
+    { "rdx", "edx", "dx", "dl", NULL },
+    { "rsi", "esi", "si", "sil", NULL },
+    { "rdi", "edi", "di", "dil", NULL },
+    { "rbp", "ebp", "bp", "bpl", NULL },
+    { "rsp", "esp", "sp", "spl", NULL },
+    { "r8", "r8d", "r8w", "r8b", NULL },
+    { "r9", "r9d", "r9w", "r9b", NULL },
+    { "r10", "r10d", "r10w", "r10b", NULL },
+    { "r11", "r11d", "r11w", "r11b", NULL },
+    { "r12", "r12d", "r12w", "r12b", NULL },
+    { "r13", "r13d", "r13w", "r13b", NULL },
+    { "r14", "r14d", "r14w", "r14b", NULL },
+    { "r15", "r15d", "r15w", "r15b", NULL },
+};
+#define NREGS ((int)(sizeof(reg_names) / sizeof(reg_names[0])))
+
+// Return the register number and its width index (0 for 64 bits, 1 for 32
+// bits, and so on) of a register name, or -1 if the name is not a register.
+static int reg_number(const char *name, int *width) {
+    for (int i = 0; i < NREGS; i++)
+        for (int j = 0; reg_names[i][j]; j++)
+            if (strcmp(reg_names[i][j], name) == 0) {
+                if (width)
+                    *width = j;
+                return i;
+            }
+    return -1;
+}
+
+static bool is_mem(const char *arg) {
+    return strchr(arg, '[') != NULL;
+}
+
+static bool is_imm(const char *arg) {
+    return isdigit(arg[0]) || (arg[0] == '-' && isdigit(arg[1]));
+}
+
+// Bit set of registers appearing in an operand.
+static unsigned regs_in(const char *arg) {
+    unsigned set = 0;
+    char word[16];
+    while (*arg) {
+        if (!isalnum(*arg)) {
+            arg++;
+            continue;
+        }
+        int n = 0;
+        while (isalnum(*arg)) {
+            if (n < 15)
+                word[n++] = *arg;
+            arg++;
+        }
+        word[n] = '\0';
+        int reg = reg_number(word, NULL);
+        if (reg >= 0)
+            set |= 1u << reg;
+    }
+    return set;
+}
+
+static unsigned reg_bit(const char *name) {
+    int reg = reg_number(name, NULL);
+    assert(reg >= 0);
+    return 1u << reg;
+}
+
+// Registers used to pass arguments, and those clobbered by a call.
+#define ARG_REGS (reg_bit("rdi") | reg_bit("rsi") | reg_bit("rdx") \
+        | reg_bit("rcx") | reg_bit("r8") | reg_bit("r9"))
+#define CALLER_SAVED (ARG_REGS | reg_bit("rax") | reg_bit("r10") | reg_bit("r11"))
+
+static bool op_is(const Insn *insn, const char *op) {
+    return insn->kind == IN_OP && strcmp(insn->op, op) == 0;
+}
+
+static bool is_jcc(const Insn *insn) {
+    return insn->kind == IN_OP && insn->op[0] == 'j' && strcmp(insn->op, "jmp") != 0;
+}
+
+// Compute registers read and fully written by an instruction. Returns false
+// if the instruction is not known, in which case nothing can be assumed.
+// Writing a 32-bit register zero-extends it and thus writes it fully while
+// writing 8- or 16-bit registers merges into the old value.
+static bool insn_regs(const Insn *insn, unsigned *reads, unsigned *writes) {
+    *reads = 0;
+    *writes = 0;
+    if (insn->kind != IN_OP)
+        return true;
+
+    const char *op = insn->op;
+    unsigned srcs = 0;
+    for (int i = 1; i < insn->nargs; i++)
+        srcs |= regs_in(insn->args[i]);
+
+    // Destination register, if any, and whether it is fully written.
+    unsigned dst = 0;
+    bool full = false;
+    if (insn->nargs > 0) {
+        if (is_mem(insn->args[0])) {
+            srcs |= regs_in(insn->args[0]);
+        } else {
+            int width;
+            int reg = reg_number(insn->args[0], &width);
+            if (reg >= 0) {
+                dst = 1u << reg;
+                full = width <= 1;
+            }
+        }
+    }
+
+    if (strcmp(op, "mov") == 0 || strcmp(op, "movzx") == 0 || strcmp(op, "movsxd") == 0
+            || strcmp(op, "movzb") == 0 || strcmp(op, "lea") == 0) {
+        *reads = srcs | (full ? 0 : dst);
+        *writes = full ? dst : 0;
+        return true;
+    }
+    if (strcmp(op, "imul") == 0 && insn->nargs == 3) {
+        *reads = srcs;
+        *writes = dst;
+        return true;
+    }
+    if (strcmp(op, "add") == 0 || strcmp(op, "sub") == 0 || strcmp(op, "and") == 0
+            || strcmp(op, "or") == 0 || strcmp(op, "imul") == 0 || strcmp(op, "shl") == 0
+            || strcmp(op, "shr") == 0 || strcmp(op, "sar") == 0 || strcmp(op, "neg") == 0) {
+        *reads = srcs | dst;
+        *writes = 0;
+        return true;
+    }
+    if (strcmp(op, "xor") == 0) {
+        // Zeroing idiom.
+        if (insn->nargs == 2 && strcmp(insn->args[0], insn->args[1]) == 0) {
+            *writes = full ? dst : 0;
+            *reads = full ? 0 : dst;
+            return true;
+        }
+        *reads = srcs | dst;
+        return true;
+    }
+    if (strcmp(op, "cmp") == 0 || strcmp(op, "test") == 0) {
+        *reads = srcs | dst;
+        return true;
+    }
+    if (strncmp(op, "set", 3) == 0) {
+        *reads = dst;
+        return true;
+    }
+    if (strcmp(op, "push") == 0) {
+        *reads = srcs | dst | reg_bit("rsp");
+        return true;
+    }
+    if (strcmp(op, "pop") == 0) {
+        *reads = reg_bit("rsp");
+        *writes = dst;
+        return true;
+    }
+    if (strcmp(op, "cltd") == 0 || strcmp(op, "cqto") == 0) {
+        *reads = reg_bit("rax");
+        *writes = reg_bit("rdx");
+        return true;
+    }
+    if (strcmp(op, "idiv") == 0) {
+        *reads = srcs | dst | reg_bit("rax") | reg_bit("rdx");
+        *writes = reg_bit("rax") | reg_bit("rdx");
+        return true;
+    }
+    if (strcmp(op, "call") == 0) {
+        // rax may carry the number of vector registers for varargs.
+        *reads = ARG_REGS | reg_bit("rax");
+        *writes = CALLER_SAVED;
+        return true;
+    }
+    return false;
+}
+
+// Registers that an instruction may modify. Unlike the writes of insn_regs(),
+// these include registers whose old values are also read.
+static unsigned insn_clobbers(const Insn *insn) {
+    if (insn->kind != IN_OP)
+        return 0;
+    const char *op = insn->op;
+    if (strcmp(op, "cmp") == 0 || strcmp(op, "test") == 0 || strcmp(op, "push") == 0
+            || strcmp(op, "ret") == 0 || op[0] == 'j')
+        return 0;
+    if (strcmp(op, "call") == 0)
+        return CALLER_SAVED;
+    if (strcmp(op, "cltd") == 0 || strcmp(op, "cqto") == 0)
+        return reg_bit("rdx");
+    if (strcmp(op, "idiv") == 0 || strcmp(op, "div") == 0 || strcmp(op, "mul") == 0)
+        return reg_bit("rax") | reg_bit("rdx");
+    if (strcmp(op, "rep") == 0)
+        return reg_bit("rdi") | reg_bit("rsi") | reg_bit("rcx");
+
+    unsigned set = 0;
+    for (int i = 0; i < insn->nargs && i < (strcmp(op, "xchg") == 0 ? 2 : 1); i++) {
+        int reg = is_mem(insn->args[i]) ? -1 : reg_number(insn->args[i], NULL);
+        if (reg >= 0)
+            set |= 1u << reg;
+    }
+    return set;
+}
+
+// Return true if an instruction emitted for the current function may modify
+// a register.
+bool emitted_clobbers(const char *reg) {
+    if (!insns)
+        return false;
+    unsigned bit = reg_bit(reg);
+    for (int i = 0; i < insns->len; i++)
+        if (insn_clobbers(insns->data[i]) & bit)
+            return true;
+    return false;
+}
+
+// Index of a label in the instruction list, or -1.
+static int find_label(const Vector *v, const char *name) {
+    for (int i = 0; i < v->len; i++) {
+        const Insn *insn = (Insn *)v->data[i];
+        if (insn->kind == IN_LABEL && strcmp(insn->op, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Returns true if the value of a register at instruction i is overwritten
+// before being read on every path. Jumps are followed up to a limited depth.
+static bool reg_dead_at(const Vector *v, int i, unsigned reg, int depth) {
+    if (depth > 4)
+        return false;
+    for (; i < v->len; i++) {
+        const Insn *insn = (Insn *)v->data[i];
+        if (insn->kind != IN_OP)
+            continue;
+        if (strcmp(insn->op, "ret") == 0)
+            return !(reg & (reg_bit("rax") | reg_bit("rdx")));
+        if (strcmp(insn->op, "jmp") == 0 || is_jcc(insn)) {
+            int target = find_label(v, insn->args[0]);
+            if (target < 0 || !reg_dead_at(v, target, reg, depth + 1))
+                return false;
+            if (strcmp(insn->op, "jmp") == 0)
+                return true;
+            continue;
+        }
+        unsigned reads, writes;
+        if (!insn_regs(insn, &reads, &writes))
+            return false;
+        if (reads & reg)
+            return false;
+        if (writes & reg)
+            return true;
+    }
+    return false;
+}
+
+
+// =============================================================================
+// Peephole rules.
+// =============================================================================
+// A rule looks at a window of instructions starting at a position and
+// rewrites them in place. Instructions are removed by marking them deleted.
+typedef struct {
+    const char *name;
+    int window;     // Number of instructions the rule looks at.
+    bool (*apply)(Vector *v, int i, Insn **w);
+    int count;      // Number of times the rule fired.
+} Rule;
+
+static void delete_insn(Insn *insn) {
+    insn->kind = IN_DELETED;
+}
+
+// Position of an instruction in the list.
+static int index_of(const Vector *v, const Insn *insn) {
+    for (int i = 0; i < v->len; i++)
+        if (v->data[i] == insn)
+            return i;
+    return -1;
+}
+
+static void set_arg(Insn *insn, int n, const char *arg) {
+    insn->args[n] = copy_string(arg);
+}
+
+// Name of a register in the given width index.
+static const char *reg_name(int reg, int width) {
+    return reg_names[reg][width];
+}
+
+// push X; pop Y => mov Y, X
+static bool push_pop(Vector *v, int i, Insn **w) {
+    (void)v;
+    (void)i;
+    if (!op_is(w[0], "push") || !op_is(w[1], "pop"))
+        return false;
+    if (strcmp(w[0]->args[0], w[1]->args[0]) == 0) {
+        delete_insn(w[0]);
+        delete_insn(w[1]);
+        return true;
+    }
+    w[1]->op = "mov";
+    w[1]->nargs = 2;
+    w[1]->args[1] = w[0]->args[0];
+    delete_insn(w[0]);
+    return true;
+}
+
+// mov eax, N; push rax => push N, if rax is not used afterwards.
+static bool push_imm(Vector *v, int i, Insn **w) {
+    (void)i;
+    if (!op_is(w[0], "mov") || !op_is(w[1], "push") || !is_imm(w[0]->args[1]))
+        return false;
+    int width;
+    if (reg_number(w[0]->args[0], &width) != reg_number(w[1]->args[0], NULL) || width > 1)
+        return false;
+    // push sign-extends a 32-bit immediate while mov to a 32-bit register
+    // zero-extends it.
+    if (width == 1 && w[0]->args[1][0] == '-')
+        return false;
+    if (!reg_dead_at(v, index_of(v, w[1]) + 1, regs_in(w[1]->args[0]), 0))
+        return false;
+    w[1]->args[0] = w[0]->args[1];
+    delete_insn(w[0]);
+    return true;
+}
+
+// op rax, X; mov rdi, rax => op rdi, X, if op fully writes rax without
+// reading it and rax is not used afterwards.
+static bool forward_mov(Vector *v, int i, Insn **w) {
+    (void)i;
+    if (!op_is(w[1], "mov") || w[0]->kind != IN_OP || w[0]->nargs != 2)
+        return false;
+    if (!op_is(w[0], "mov") && !op_is(w[0], "lea") && !op_is(w[0], "movzx")
+            && !op_is(w[0], "movsxd"))
+        return false;
+    int dwidth, swidth;
+    int dst = reg_number(w[1]->args[0], &dwidth);
+    int src = reg_number(w[1]->args[1], &swidth);
+    int width;
+    int reg = reg_number(w[0]->args[0], &width);
+    if (dst < 0 || src < 0 || reg != src || dwidth != 0 || swidth != 0 || width > 1)
+        return false;
+    if (!reg_dead_at(v, index_of(v, w[1]) + 1, 1u << reg, 0))
+        return false;
+    set_arg(w[0], 0, reg_name(dst, width));
+    delete_insn(w[1]);
+    return true;
+}
+
+// push X; op; pop Y => mov Y, X; op, if op neither uses Y nor the stack.
+static bool push_op_pop(Vector *v, int i, Insn **w) {
+    (void)v;
+    (void)i;
+    if (!op_is(w[0], "push") || w[1]->kind != IN_OP || !op_is(w[2], "pop"))
+        return false;
+    int x = reg_number(w[0]->args[0], NULL);
+    int y = reg_number(w[2]->args[0], NULL);
+    if (x < 0 || y < 0 || x == y)
+        return false;
+    if (op_is(w[1], "push") || op_is(w[1], "pop") || op_is(w[1], "call"))
+        return false;
+    unsigned reads, writes;
+    if (!insn_regs(w[1], &reads, &writes))
+        return false;
+    unsigned used = reads | writes;
+    for (int k = 0; k < w[1]->nargs; k++)
+        used |= regs_in(w[1]->args[k]);
+    if (used & ((1u << y) | reg_bit("rsp")))
+        return false;
+    w[0]->op = "mov";
+    w[0]->nargs = 2;
+    w[0]->args[1] = w[0]->args[0];
+    w[0]->args[0] = w[2]->args[0];
+    delete_insn(w[2]);
+    return true;
+}
+
+// mov eax, N; mov dword ptr [X], eax => mov dword ptr [X], N, if rax is not
+// used afterwards.
+static bool store_imm(Vector *v, int i, Insn **w) {
+    (void)i;
+    if (!op_is(w[0], "mov") || !op_is(w[1], "mov") || !is_imm(w[0]->args[1])
+            || !is_mem(w[1]->args[0]))
+        return false;
+    int reg = reg_number(w[0]->args[0], NULL);
+    int width;
+    if (reg < 0 || reg_number(w[1]->args[1], &width) != reg)
+        return false;
+    if (regs_in(w[1]->args[0]) & (1u << reg))
+        return false;
+    if (!reg_dead_at(v, index_of(v, w[1]) + 1, 1u << reg, 0))
+        return false;
+
+    // Truncate the immediate to the width of the store. A 64-bit store
+    // sign-extends a 32-bit immediate, which works as long as the value was
+    // loaded to rax as is or is non-negative.
+    long long val = strtoll(w[0]->args[1], NULL, 10);
+    if (width == 2)
+        val = (short)val;
+    else if (width == 3)
+        val = (signed char)val;
+    char *buf = malloc(24);
+    sprintf(buf, "%lld", val);
+    w[1]->args[1] = buf;
+    delete_insn(w[0]);
+    return true;
+}
+
+// mov qword ptr M, R; mov R, qword ptr M => mov qword ptr M, R
+// A narrower reload is kept since it clears the upper bits of the register.
+static bool store_load(Vector *v, int i, Insn **w) {
+    (void)v;
+    (void)i;
+    if (!op_is(w[0], "mov") || !op_is(w[1], "mov") || !is_mem(w[0]->args[0]))
+        return false;
+    if (strcmp(w[0]->args[0], w[1]->args[1]) != 0 || strcmp(w[0]->args[1], w[1]->args[0]) != 0)
+        return false;
+    if (strncmp(w[0]->args[0], "qword ptr ", 10) != 0)
+        return false;
+    delete_insn(w[1]);
+    return true;
+}
+
+// mov eax, dword ptr X; movsxd rax, eax => movsxd rax, dword ptr X
+static bool load_sign_extend(Vector *v, int i, Insn **w) {
+    (void)v;
+    (void)i;
+    if (!op_is(w[0], "mov") || !op_is(w[1], "movsxd") || !is_mem(w[0]->args[1]))
+        return false;
+    int width;
+    int reg = reg_number(w[0]->args[0], &width);
+    if (reg < 0 || width != 1 || strcmp(w[1]->args[1], w[0]->args[0]) != 0
+            || reg_number(w[1]->args[0], NULL) != reg)
+        return false;
+    w[1]->args[1] = w[0]->args[1];
+    delete_insn(w[0]);
+    return true;
+}
+
+// Negated condition code of a set or a jump instruction.
+static const char *negate_cc(const char *cc) {
+    static const char *pairs[][2] = {
+        { "e", "ne" }, { "l", "ge" }, { "g", "le" }, { "b", "ae" }, { "a", "be" },
+    };
+    for (int i = 0; i < (int)(sizeof(pairs) / sizeof(pairs[0])); i++) {
+        if (strcmp(cc, pairs[i][0]) == 0)
+            return pairs[i][1];
+        if (strcmp(cc, pairs[i][1]) == 0)
+            return pairs[i][0];
+    }
+    return NULL;
+}
+
+// cmp X, Y; setCC al; movzb rax, al; cmp eax, 0; je L => cmp X, Y; jNCC L
+// (jne L => jCC L), if rax is not used afterwards.
+static bool fuse_setcc_branch(Vector *v, int i, Insn **w) {
+    (void)i;
+    if (!op_is(w[0], "cmp") || w[1]->kind != IN_OP || strncmp(w[1]->op, "set", 3) != 0
+            || !op_is(w[2], "movzb") || !op_is(w[3], "cmp")
+            || (!op_is(w[4], "je") && !op_is(w[4], "jne")))
+        return false;
+    if (strcmp(w[1]->args[0], "al") != 0 || strcmp(w[2]->args[0], "rax") != 0
+            || reg_number(w[3]->args[0], NULL) != reg_number("rax", NULL)
+            || strcmp(w[3]->args[1], "0") != 0)
+        return false;
+    const char *cc = w[1]->op + 3;
+    if (op_is(w[4], "je"))
+        cc = negate_cc(cc);
+    if (!cc)
+        return false;
+    int target = find_label(v, w[4]->args[0]);
+    if (target < 0 || !reg_dead_at(v, target, reg_bit("rax"), 0)
+            || !reg_dead_at(v, index_of(v, w[4]) + 1, reg_bit("rax"), 0))
+        return false;
+    char *op = malloc(strlen(cc) + 2);
+    sprintf(op, "j%s", cc);
+    w[4]->op = op;
+    delete_insn(w[1]);
+    delete_insn(w[2]);
+    delete_insn(w[3]);
+    return true;
+}
+
+// jmp L; L: => L: (also for conditional jumps and over other labels).
+static bool jump_to_next(Vector *v, int i, Insn **w) {
+    (void)w;
+    Insn *jump = (Insn *)v->data[i];
+    if (!op_is(jump, "jmp") && !is_jcc(jump))
+        return false;
+    for (int j = i + 1; j < v->len; j++) {
+        Insn *insn = (Insn *)v->data[j];
+        if (insn->kind == IN_DELETED || insn->kind == IN_DIRECTIVE)
+            continue;
+        if (insn->kind != IN_LABEL)
+            return false;
+        if (strcmp(insn->op, jump->args[0]) == 0) {
+            delete_insn(jump);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Instructions after an unconditional jump or a return are unreachable
+// until the next label.
+static bool unreachable(Vector *v, int i, Insn **w) {
+    (void)w;
+    Insn *insn = (Insn *)v->data[i];
+    if (!op_is(insn, "jmp") && !op_is(insn, "ret"))
+        return false;
+    bool changed = false;
+    for (int j = i + 1; j < v->len; j++) {
+        Insn *next = (Insn *)v->data[j];
+        if (next->kind == IN_LABEL)
+            break;
+        if (next->kind == IN_OP) {
+            delete_insn(next);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static Rule rules[] = {
+    { "push-pop", 2, push_pop, 0 },
+    { "push-imm", 2, push_imm, 0 },
+    { "push-op-pop", 3, push_op_pop, 0 },
+    { "forward-mov", 2, forward_mov, 0 },
+    { "store-imm", 2, store_imm, 0 },
+    { "store-load", 2, store_load, 0 },
+    { "load-sign-extend", 2, load_sign_extend, 0 },
+    { "fuse-setcc-branch", 5, fuse_setcc_branch, 0 },
+    { "jump-to-next", 1, jump_to_next, 0 },
+    { "unreachable", 1, unreachable, 0 },
+};
+#define NRULES ((int)(sizeof(rules) / sizeof(rules[0])))
+
+// Collect a window of n instructions starting at i, skipping deleted ones.
+// Returns false if there are not enough instructions.
+static bool get_window(Vector *v, int i, int n, Insn **w) {
+    int k = 0;
+    for (; i < v->len && k < n; i++) {
+        Insn *insn = (Insn *)v->data[i];
+        if (insn->kind != IN_DELETED)
+            w[k++] = insn;
+    }
+    return k == n;
+}
+
+static void compact(Vector *v) {
+    int n = 0;
+    for (int i = 0; i < v->len; i++) {
+        Insn *insn = (Insn *)v->data[i];
+        if (insn->kind != IN_DELETED)
+            v->data[n++] = insn;
+    }
+    v->len = n;
+}
+
+// Apply the rules repeatedly until none of them fires.
+void peephole(Vector *v) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < v->len; i++) {
+            if (((Insn *)v->data[i])->kind == IN_DELETED)
+                continue;
+            for (int r = 0; r < NRULES; r++) {
+                Insn *w[8];
+                if (!get_window(v, i, rules[r].window, w))
+                    continue;
+                if (rules[r].apply(v, i, w)) {
+                    rules[r].count++;
+                    changed = true;
+                    if (((Insn *)v->data[i])->kind == IN_DELETED)
+                        break;
+                }
+            }
+        }
+        compact(v);
+    }
+}
+
+// Print how many times each rule fired.
+void peephole_report(void) {
+    for (int r = 0; r < NRULES; r++)
+        fprintf(stderr, "peephole: %s: %d\n", rules[r].name, rules[r].count);
+}
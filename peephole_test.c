@@ -0,0 +1,87 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "cc.h"
+
+// Run the peephole optimizer on lines of assembly separated by ';' and
+// compare the result with the expected lines.
+static void expect(int line, const char *expected, const char *input) {
+    Vector *insns = new_vector();
+    char buf[512];
+    strcpy(buf, input);
+    for (char *p = strtok(buf, ";"); p; p = strtok(NULL, ";"))
+        vec_push(insns, parse_insn(p));
+
+    peephole(insns);
+
+    char actual[512] = "";
+    for (int i = 0; i < insns->len; i++) {
+        const Insn *insn = insns->data[i];
+        if (i > 0)
+            strcat(actual, "; ");
+        strcat(actual, insn->op);
+        if (insn->kind == IN_LABEL)
+            strcat(actual, ":");
+        for (int j = 0; j < insn->nargs; j++) {
+            strcat(actual, j == 0 ? " " : ", ");
+            strcat(actual, insn->args[j]);
+        }
+    }
+    if (strcmp(expected, actual) == 0)
+        return;
+    fprintf(stderr, "Peephole test line %d: \"%s\" expected, but got \"%s\"\n",
+            line, expected, actual);
+    exit(1);
+}
+
+static void peephole_rules_test() {
+    expect(__LINE__,
+            "mov rdi, rax; ret",
+            "push rax; pop rdi; ret");
+    expect(__LINE__,
+            "mov rdi, rax; mov eax, dword ptr [rbp-8]; add eax, edi; ret",
+            "push rax; mov eax, dword ptr [rbp-8]; pop rdi; add eax, edi; ret");
+    expect(__LINE__,
+            "push 3; mov eax, 1; ret",
+            "mov eax, 3; push rax; mov eax, 1; ret");
+    // rax is returned.
+    expect(__LINE__,
+            "mov eax, 3; push rax; ret",
+            "mov eax, 3; push rax; ret");
+    expect(__LINE__,
+            "lea rdi, [rbp-16]; mov eax, 1; ret",
+            "lea rax, [rbp-16]; mov rdi, rax; mov eax, 1; ret");
+    expect(__LINE__,
+            "mov dword ptr [rbp-8], 2; mov eax, 0; ret",
+            "mov eax, 2; mov dword ptr [rbp-8], eax; mov eax, 0; ret");
+    expect(__LINE__,
+            "mov byte ptr [rbp-8], 1; mov eax, 0; ret",
+            "mov eax, 257; mov byte ptr [rbp-8], al; mov eax, 0; ret");
+    expect(__LINE__,
+            "mov qword ptr [rbp-8], rax; mov rax, qword ptr [rax]; ret",
+            "mov qword ptr [rbp-8], rax; mov rax, qword ptr [rbp-8]; mov rax, qword ptr [rax]; ret");
+    expect(__LINE__,
+            "mov dword ptr [rbp-8], eax; mov eax, dword ptr [rbp-8]; ret",
+            "mov dword ptr [rbp-8], eax; mov eax, dword ptr [rbp-8]; ret");
+    expect(__LINE__,
+            "movsxd rax, dword ptr [rbp-8]; ret",
+            "mov eax, dword ptr [rbp-8]; movsxd rax, eax; ret");
+    expect(__LINE__,
+            "cmp eax, 10; jge .L1; mov eax, 1; .L1:; mov eax, 0; ret",
+            "cmp eax, 10; setl al; movzb rax, al; cmp eax, 0; je .L1; mov eax, 1; .L1:; mov eax, 0; ret");
+    expect(__LINE__,
+            "mov eax, 1; .L1:; ret",
+            "mov eax, 1; jmp .L1; .L1:; ret");
+    expect(__LINE__,
+            "ret; .L1:; ret",
+            "ret; mov eax, 1; .L1:; ret");
+    expect(__LINE__,
+            "xor rax, rax; call puts; ret",
+            "xor rax, rax; call puts; ret");
+
+    fprintf(stderr, "Peephole rules test OK\n");
+}
+
+void runtest_peephole() {
+    peephole_rules_test();
+}
@@ -18,13 +18,22 @@ void allocptr4(int ***pp, int x0, int x1, int x2, int x3) {
     *pp = malloc(4 * sizeof(int*));
     (*pp)[0] = &p[0]; (*pp)[1] = &p[1]; (*pp)[2] = &p[2]; (*pp)[3] = &p[3];
 }
+struct gpt { int x; int y; };
+struct gbig { int v[6]; };
+struct gpt gpt_swap(struct gpt p) { struct gpt q = { p.y, p.x }; return q; }
+struct gbig gbig_fill(int x) { struct gbig b; for (int i = 0; i < 6; i++) b.v[i] = x * i; return b; }
+int gbig_sum(int k, struct gbig b, int m) { int s = 0; for (int i = 0; i < 6; i++) s += b.v[i]; return s * k + m; }
+int addr_mod(void *p, int n) { return (unsigned long)p % n; }
 ' | gcc -xc -c -o tmp_funcs.o -
 
 # Run all test cases (functions TESTCASE_[0-9].*) found in a C source.
 # We use gcc preprocessor to expand macros.
+# The list is taken before main is appended, so that grep does not read back
+# its own output.
 gcc -E -P test/test.c > test/tmp_test.c
+testcases=$(grep -o 'TESTCASE_[0-9].*()' test/tmp_test.c | awk '{print $1";"}')
 echo 'int main() {' >> test/tmp_test.c
-grep -o 'TESTCASE_[0-9].*()' test/tmp_test.c | awk '{print $1";"}' >> test/tmp_test.c
+echo "$testcases" >> test/tmp_test.c
 echo 'printf("\n");' >> test/tmp_test.c
 echo '}' >> test/tmp_test.c
 ./cc test/tmp_test.c > test/tmp_test.s
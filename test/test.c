@@ -131,6 +131,9 @@ EXPECT(7) { int ar[3]; ar[0] = 1; ar[1] = 2; ar[2] = 4; return *ar + *(ar+1) + *
 EXPECT(2) { int ar[3]; int i; i = 1; ar[i] = 2; return ar[i]; }
 EXPECT(2) { int ar[2]; ar[1] = 2; ar[0] = 1; return ar[1]; }
 EXPECT(7) { int ar[3]; ar[2] = 4; ar[1] = 2; ar[0] = 1; return ar[0] + ar[1] + ar[2]; }
+EXPECT(3) { int ar[3]; int i = 2; ar[i-1] = 3; return ar[1]; }
+EXPECT(5) { int ar[3]; int *p = &ar[2]; int i = -1; ar[1] = 5; return p[i]; }
+EXPECT(6) { int ar[4]; int i = 3; ar[0] = 2; ar[3] = 4; return ar[i] + ar[i-3]; }
 
 // Other integer types.
 EXPECT(3) { char c0; char c1; c0 = -5; c1 = c0+8; return c1; }
@@ -244,6 +247,11 @@ EXPECT(0) { int i; int j; i = j = 2+3*4 != 14; return i + j; }
 EXPECT(0) { char c0 = 1; char c1 = 2; return c0 > c1; }
 EXPECT(1) { int i = 256 + 1; char c = 2; return i > c; }
 EXPECT(1) { int i = 256 + 1; char *pc = &i; char c = 2; return *pc < c; }
+EXPECT(1) { int x = 7; return 3 < x; }
+EXPECT(0) { int x = 7; return 7 < x; }
+EXPECT(1) { int x = 7; return 7 >= x; }
+EXPECT(1) { int x = 7; int *p = &x; return 7 == *p; }
+EXPECT(1) { int x = -7; return x < 3; }
 
 // Logical expressions.
 EXPECT(0) { char x1 = 0; char x2 = 0; return x1 || x2; }
@@ -303,6 +311,81 @@ EXPECT(7) { char x = 5; x |= 7; return x; }
 EXPECT(2) { int x = 5; x ^= 7; return x; }
 EXPECT(2) { char x = 5; x ^= 7; return x; }
 EXPECT(5) { int x = 5; x &= 7; return x; }
+EXPECT(1) { int x = 7; x %= 4; return x == 3; }
+EXPECT(37) { int a[3]; int i = 1; a[1] = 3; a[2] = 7; a[i++] += 4; return a[1] * 5 + i; }
+EXPECT(13) { int a[3]; int *p = a; a[0] = 10; a[1] = 1; *p++ += 2; return a[0] + *p; }
+EXPECT(11) { int a[4]; int i = 1; int j = 2; a[3] = 8; a[i+j] += 3; return a[3]; }
+EXPECT(25) { int a[4]; int i = 1; a[2] = 4; ++a[i+1]; return a[2] * a[i+1]; }
+
+// Immediate and memory operands.
+EXPECT(21) { int x = 7; return x * 3; }
+EXPECT(21) { int x = 7; return 3 * x; }
+EXPECT(14) { int x = 7; return 100 / x; }
+EXPECT(3) { int x = 7; return 10 - x; }
+EXPECT(48) { int x = 7; return (x + 1) * (x - 1); }
+EXPECT(7) { char c = 3; int i = 4; return i + c; }
+EXPECT(7) { short s = 3; int i = 4; return s + i; }
+EXPECT(-14) { int x = -7; int y = 2; return x * y; }
+EXPECT(-3) { int x = -7; int y = 2; return x / y; }
+
+// Multiplication, division and modulo by constants.
+EXPECT(1) { return 7 % 3; }
+EXPECT(-1) { return -7 % 3; }
+EXPECT(2) { int x = 17; int y = 5; return x % y; }
+int mul_by_constants(int x) {
+    int d = 0;
+    int m;
+    m = 0; if (x * 0 != x * m) d = d + 1;
+    m = 1; if (x * 1 != x * m) d = d + 1;
+    m = -1; if (x * -1 != x * m) d = d + 1;
+    m = 2; if (x * 2 != x * m) d = d + 1;
+    m = 3; if (x * 3 != x * m) d = d + 1;
+    m = 5; if (x * 5 != x * m) d = d + 1;
+    m = 9; if (x * 9 != x * m) d = d + 1;
+    m = 12; if (x * 12 != x * m) d = d + 1;
+    m = 40; if (x * 40 != x * m) d = d + 1;
+    m = -24; if (x * -24 != x * m) d = d + 1;
+    m = 7; if (x * 7 != x * m) d = d + 1;
+    m = 1024; if (x * 1024 != x * m) d = d + 1;
+    return d;
+}
+int div_by_constants(int x) {
+    int d = 0;
+    int y;
+    y = 1; if (x / 1 != x / y || x % 1 != x % y) d = d + 1;
+    y = -1; if (x / -1 != x / y || x % -1 != x % y) d = d + 1;
+    y = 2; if (x / 2 != x / y || x % 2 != x % y) d = d + 1;
+    y = 4; if (x / 4 != x / y || x % 4 != x % y) d = d + 1;
+    y = -4; if (x / -4 != x / y || x % -4 != x % y) d = d + 1;
+    y = 1024; if (x / 1024 != x / y || x % 1024 != x % y) d = d + 1;
+    y = 3; if (x / 3 != x / y || x % 3 != x % y) d = d + 1;
+    y = 5; if (x / 5 != x / y || x % 5 != x % y) d = d + 1;
+    y = 6; if (x / 6 != x / y || x % 6 != x % y) d = d + 1;
+    y = 7; if (x / 7 != x / y || x % 7 != x % y) d = d + 1;
+    y = 10; if (x / 10 != x / y || x % 10 != x % y) d = d + 1;
+    y = -3; if (x / -3 != x / y || x % -3 != x % y) d = d + 1;
+    y = -7; if (x / -7 != x / y || x % -7 != x % y) d = d + 1;
+    y = 641; if (x / 641 != x / y || x % 641 != x % y) d = d + 1;
+    y = 1000000007; if (x / 1000000007 != x / y || x % 1000000007 != x % y) d = d + 1;
+    return d;
+}
+EXPECT(0) {
+    int x; int d = 0;
+    for (x = -1000; x <= 1000; x++)
+        d = d + mul_by_constants(x) + div_by_constants(x);
+    return d;
+}
+EXPECT(0) {
+    return div_by_constants(2147483647) + div_by_constants(-2147483647)
+        + div_by_constants(1000000007) + div_by_constants(-1000000008)
+        + mul_by_constants(123456) + mul_by_constants(-98765);
+}
+EXPECT(11) {
+    struct { int x; int y; int z; int w; char c; } ar[3];
+    int i = 2;
+    (ar[i]).w = 5; (ar[i-1]).c = 6;
+    return (ar[2]).w + (ar[1]).c;
+}
 EXPECT(5) { char x = 5; x &= 7; return x; }
 
 // Global variables.
@@ -332,7 +415,7 @@ EXPECT(15) {
 EXPECT(0) {
     gvar_arc[2] = 4; gvar_arc[1] = 2; gvar_arc[0] = 1;
     int *pi = &gvar_arc;
-    return *pi - (4*256*256 + 2*256 + 1);
+    return (*pi & 16777215) - (4*256*256 + 2*256 + 1);
 }
 
 // Functions.
@@ -361,6 +444,8 @@ int myfunc8(int x0, int x1, int x2, int x3, int x4, int x5, int x6, int x7) {
 }
 EXPECT(654321) { return myfunc6(1, 2, 3, 4, 5, 6); }
 EXPECT(87654321) { return myfunc8(1, 2, 3, 4, 5, 6, 7, 8); }
+EXPECT(87654321) { int x = 6; return myfunc8(1, 2, 3, 4, 5, 6, x + 1, two() * 4); }
+EXPECT(82654322) { return 1 + func8(1, 2, 3, 4, 5, 6, myfunc8(0, 0, 0, 0, 0, 0, 2, 0) / 1000000, 8); }
 
 // Selection and iteration statements.
 EXPECT(0) { if (0) return 1; return 0; }
@@ -404,6 +489,15 @@ EXPECT(10) { int sum = 0; int i; for (i = 4; i >= 0; i = i - 1) sum = sum + i; r
 EXPECT(5) { int i = 0; for ( ; i < 5; i = i + 1) ; return i; }
 EXPECT(5) { int i = 5; for ( ; i < 5; i = i + 1) ; return i; }
 EXPECT(5) { int i = 0; for ( ; i < 5; ) i = i + 1; return i; }
+EXPECT(5) { int i = 0; for (;;) { if (i == 5) return i; i = i + 1; } }
+EXPECT(3) { int i = 0; int j = 5; while (i < 3 && j > 0) { i = i + 1; j = j - 1; } return i; }
+EXPECT(12) {
+    int sum = 0; int i; int j;
+    for (i = 0; i < 3; i = i + 1)
+        for (j = 0; j < 4; j = j + 1)
+            sum = sum + 1;
+    return sum;
+}
 EXPECT(34) {
     int sum = 0;
     int prod = 1;
@@ -423,6 +517,197 @@ EXPECT(13) {
     return fib[6];
 }
 
+// Constant propagation and dead code elimination.
+EXPECT(44) { char c = 300; int x = c; return x; }
+EXPECT(3) { int x = 2; int y = x; x = 3; return y + 1; }
+EXPECT(7) { int x = 1; int y; if (x) y = 7; else y = 8; return y; }
+EXPECT(2) { int x = 1; int y = 0; if ((y = 2)) x = 0; return x + y; }
+EXPECT(1) { int x = 0; int y = (x = 1) && 0; return x + y; }
+EXPECT(4) { int x = 3; int y = x * 0 + 1; while (x < 4) x = x + y; return x; }
+EXPECT(8) { int i; int x = 1; for (i = 0; i < 3; i++) x = x * 2; return x; }
+EXPECT(3) { int i = 0; int k = 1; for (;;) { if (i >= 3) return i; i = i + k; } return 100; }
+EXPECT(5) { int x = 5; while (0) x = two(); for (; 0; ) x = two(); return x; }
+EXPECT(2) { int unused = two(); int dead = unused * 3; return unused; }
+EXPECT(0) { int x; int y = 1; x = 7; x = y - 1; return x; }
+int cse_loads(int i) { int a[4]; a[2] = 2; a[3] = 3; return a[i+1] * a[i+1] + a[i+2] * a[i+2] * 4; }
+EXPECT(40) { return cse_loads(1); }
+int cse_store(int i) { int a[4]; int x; a[2] = 2; x = a[i+1]; a[i+1] = 5; return x + a[i+1]; }
+EXPECT(7) { return cse_store(1); }
+int cse_index(int i) { int a[4]; int x; a[2] = 2; x = a[i+1]; i = 2; a[3] = 4; return x + a[i+1]; }
+EXPECT(6) { return cse_index(1); }
+int cse_pointer(int i) { int a[4]; int *p = a; int x; a[2] = 2; x = a[i+1]; *(p + (i+1)) = 2 * x; return a[i+1]; }
+EXPECT(4) { return cse_pointer(1); }
+int bump_global() { gvar_i2 = gvar_i2 + 1; return 0; }
+int cse_call(int i) { int a[4]; int x; a[1] = 1; a[2] = 1; gvar_i2 = i; x = a[gvar_i2]; bump_global(); return x + a[gvar_i2] + 1; }
+EXPECT(3) { return cse_call(1); }
+int cse_loop(int n) {
+    int a[8]; int s = 0; int i;
+    for (i = 0; i < n; i++) a[i] = i;
+    for (i = 1; i < n - 1; i++) {
+        s += a[i-1] * a[i-1] + a[i+1] * a[i+1];
+        a[i+1] += a[i-1];
+    }
+    return s;
+}
+EXPECT(75) { return cse_loop(6); }
+short gvar_cs = 720;
+char gvar_cc = 10;
+int cse_short() { int a[40]; int i; short s = gvar_cs; for (i = 0; i < 40; i++) a[i] = i - 20; return a[(s - 800) / 4 + 30] * 1000 + (s - 800) / 4; }
+int cse_char() { char c = gvar_cc; int x = (c - 100) * 3; return x + (c - 100) * 3; }
+EXPECT(-10020) { return cse_short(); }
+EXPECT(-540) { return cse_char(); }
+int dead_param_store(int a) { int b = a + 1; a = 4; b = a; return a + 1; }
+EXPECT(5) { return dead_param_store(100); }
+int licm_2d(int n, int m) {
+    int a[12]; int s = 0; int i; int j;
+    for (i = 0; i < 12; i++) a[i] = i;
+    for (i = 0; i < n; i++)
+        for (j = 0; j < m; j++)
+            s += a[i * m + j] * (n + m);
+    return s;
+}
+EXPECT(462) { return licm_2d(3, 4); }
+int licm_guard(int n, int k, int d) {
+    int a[4]; int s = 0; int i = 0;
+    a[k] = 5;
+    while (i < n) { s += a[k] * 100 / d; i++; }
+    return s;
+}
+EXPECT(0) { return licm_guard(0, 1, 0); }
+EXPECT(60) { return licm_guard(3, 1, 25); }
+int licm_call(int n) { int s = 0; int i; gvar_i2 = 0; for (i = 0; i < n; i++) { s += gvar_i2 * 2; bump_global(); } return s; }
+EXPECT(12) { return licm_call(4); }
+char gvar_nc = 10;
+short gvar_ns = 100;
+int licm_char(int n) { char c = gvar_nc; int s = 0; int i; for (i = 0; i < n; i++) s += ((c - 100) / 3) * 7; return s; }
+int licm_short(int n) { short v = gvar_ns; int a[8]; int i; for (i = 0; i < n; i++) { a[i] = ((v - 300) / 3) / 16; bump_global(); } return a[n - 1]; }
+EXPECT(-840) { return licm_char(4); }
+EXPECT(-4) { return licm_short(5); }
+int iv_sum(int n, int k) {
+    int a[8]; int b[8]; int s = 0; int i;
+    for (i = 0; i < 8; i++) { a[i] = i; b[i] = 10 * i; }
+    for (i = 0; i < n; i++) b[i] = a[i] + b[i + k];
+    for (i = n - 1; i >= 0; i -= 2) s += b[i];
+    return s;
+}
+EXPECT(129) { return iv_sum(6, 1); }
+int iv_used(int n) { int a[8]; int i = 0; while (i < n) { a[i] = i * 3; i++; } return a[n - 1] + i; }
+EXPECT(17) { return iv_used(5); }
+int unroll_block() {
+    int a[16]; int i; int j; int s = 0;
+    for (i = 0; i < 16; i++) a[i] = i;
+    for (i = 0; i < 4; i++)
+        for (j = 0; j < 4; j++)
+            s += a[i * 4 + j] * (i + 1);
+    return s;
+}
+EXPECT(380) { return unroll_block(); }
+int unroll_rest(int n) { int s = 0; int i; for (i = 0; i < n; i++) s += i + 1; for (i = n; i >= 1; i -= 3) s += 100; return s; }
+EXPECT(0) { return unroll_rest(0); }
+EXPECT(215) { return unroll_rest(5); }
+EXPECT(328) { return unroll_rest(7); }
+EXPECT(0) { return unroll_rest(-2147483647); }
+int vec_add(int n, int k) {
+    int a[20]; int b[20]; int c[20]; int i; int s = 0;
+    for (i = 0; i < 20; i++) { a[i] = i; b[i] = 3 * i; c[i] = 0; }
+    for (i = 0; i < n; i++) c[i] = (a[i] - b[i]) + k;
+    for (i = 0; i < 20; i++) s += c[i] * (i + 1);
+    return s;
+}
+EXPECT(12036) { return vec_add(17, 100); }
+int vec_sum(int n) {
+    char a[40]; short b[40]; int i; int s = 0;
+    for (i = 0; i < 40; i++) { a[i] = 250 + i; b[i] = 300 * i; }
+    for (i = 0; i < n; i++) s += a[i];
+    for (i = 0; i < n; i++) s += b[i];
+    return s % 251;
+}
+EXPECT(227) { return vec_sum(37); }
+int vec_overlap(int d) {
+    int a[20]; int *p = a; int *q; int i;
+    for (i = 0; i < 20; i++) a[i] = 1;
+    q = p + d;
+    for (i = 0; i < 16; i++) q[i] = p[i] + q[i];
+    return a[17] * 10 + a[19];
+}
+EXPECT(91) { return vec_overlap(2); }
+EXPECT(55) { return vec_overlap(4); }
+int tail_count(int n, int acc) {
+    if (n == 0) return acc;
+    return tail_count(n - 1, acc + 3);
+}
+EXPECT(3000000) { return tail_count(1000000, 0); }
+int tail_gcd(int a, int b) { if (b == 0) return a; return tail_gcd(b, a % b); }
+EXPECT(21) { return tail_gcd(1071, 462); }
+int tail_odd(int n) { if (n == 0) return 0; return tail_even(n - 1); }
+int tail_even(int n) { if (n == 0) return 1; return tail_odd(n - 1); }
+EXPECT(1) { return tail_even(1000000); }
+int tail_func8(int x0, int x1, int x2, int x3, int x4, int x5, int x6, int x7) {
+    return func8(x1, x0, x2, x3, x4, x5, x7, x6);
+}
+EXPECT(67543201) { return tail_func8(0, 1, 2, 3, 4, 5, 6, 7); }
+int inl_g[5];
+int inl_get(int i) { return inl_g[i]; }
+int inl_set(int i, int v) { inl_g[i] = v; return v; }
+int inl_twice(int i) { return inl_get(i) + inl_get(i); }
+EXPECT(26) { inl_set(1, 3); inl_set(inl_set(2, 3), 5); return inl_twice(1) + inl_get(2) * 0 + inl_get(3) * 4; }
+int inl_x;
+int inl_readx() { return inl_x; }
+int inl_shadow() { int inl_x = 3; inl_g[4] = 4; inl_x = inl_x + inl_get(4); return inl_x + inl_readx(); }
+EXPECT(9) { inl_x = 2; return inl_shadow(); }
+int inl_bump(int i) { int a[3]; a[0] = 1; a[1] = 1; a[2] = 1; a[i++] += 5; return a[0] * 100 + a[1] * 10 + i; }
+EXPECT(611) { return inl_bump(0); }
+int inl_low(int x) { char c = x; return c; }
+EXPECT(2) { return inl_low(258); }
+int rz_leaf(int a, int b) {
+    int x[4]; int i;
+    for (i = 0; i < 4; i++) x[i] = a * i + b;
+    return (x[0] + (x[1] * (x[2] - (x[3] / (a + (b - 1)))))) * 2;
+}
+EXPECT(64) { return rz_leaf(3, 2); }
+int prm_mix(char c, short s, int *p, int i) { *p = c + s; return i - *p; }
+EXPECT(4508) { int x; int r = prm_mix(300, 70000, &x, 1000); return x; }
+int prm_div(int a, int b, int c) { a = a * 10; return a / b + c % b; }
+EXPECT(25) { return prm_div(7, 3, 8); }
+int prm_sub6(int a, int b, int c, int d, int e, int f) { return a - (b - (c - (d - (e - f)))); }
+EXPECT(-91) { int x = 5; int a[2]; a[1] = 7; return prm_sub6(x, prm_sub6(1, 2, 3, 4, 5, 6), -2, a[1], x * 2, 100); }
+int prm_sum(int *p, int n) { int s = 0; int i; for (i = 0; i < n; i++) s += p[i]; return s; }
+EXPECT(12) { int a[3]; a[0] = 3; a[1] = 4; a[2] = 5; return prm_sum(a, 3); }
+
+// Prototypes.
+int *proto_ptr(int *p, int i);
+char proto_char(int x);
+short proto_short(int);
+int sprintf(char *buf, char *fmt, ...);
+int proto_any();
+int proto_none(void);
+EXPECT(7) { int a[3]; a[2] = 7; return *proto_ptr(a, 2); }
+EXPECT(44) { return proto_char(300); }
+EXPECT(1) { int x = 300; char c = proto_char(x); return c == 44; }
+EXPECT(4464) { return proto_short(70000); }
+EXPECT(4) { char buf[16]; int n = sprintf(buf, "%d-%d", 12, 3); return n * (buf[2] == 45); }
+int *proto_ptr(int *p, int i) { return p + i; }
+char proto_char(int x) { return x; }
+short proto_short(int x) { int y = x; return y; }
+int proto_low(char c) { return c; }
+EXPECT(2) { int x = 258; return proto_low(x); }
+EXPECT(7) { return proto_any(3, 4); }
+EXPECT(3) { return proto_none() + 2; }
+int proto_any(int a, int b) { return a + b; }
+int proto_none(void) { return 1; }
+
+// Block scopes.
+EXPECT(1) { int x = 1; { int x = 2; x = x + 1; } return x; }
+EXPECT(300) { int x = 300; { char x = 1; x = x + 1; } return x; }
+EXPECT(6) { int i; int s = 0; for (i = 0; i < 3; i++) { int t = i * 2; s = s + t; } return s; }
+EXPECT(33) {
+    int s = 0;
+    { int a[4]; a[0] = 1; a[3] = 2; s = s + a[0] + a[3]; }
+    { int b[4]; b[0] = 10; b[3] = 20; s = s + b[0] + b[3]; }
+    return s;
+}
+EXPECT(70303) { char a; char b; int c; short d; a = 200; b = 100; c = 70000; d = 3; return a + (b + (c + d)); }
+
 // String literals.
 EXPECT(0) { char *s; s = ""; return *s; }
 EXPECT(72) { char *s = "Hello, world!"; return s[0]; }
@@ -430,6 +715,8 @@ EXPECT(33) { char *s = "Hello, world!"; return *(s+12); }
 EXPECT(0) { char *s = "Hello, world!"; return s[13]; }
 EXPECT(32) { char *s1 = "ABC"; char *s2 = "abc"; return s2[1] - s1[1]; }
 EXPECT(1) { return puts("Hello, world!") >= 0; }
+EXPECT(1) { char *s1 = "dup"; char *s2 = "dup"; return s1 == s2; }
+EXPECT(0) { char *s1 = "dup"; char *s2 = "dup2"; return s1 == s2; }
 
 // Struct.
 EXPECT(0) { struct {} s; }
@@ -492,6 +779,167 @@ EXPECT(0) {
     return 0;
 }
 
+EXPECT(9) {
+    struct { int x; int y; int z; } ar[3];
+    int i = 2;
+    (ar[i]).z = 4; (ar[1]).y = 5; (ar[0]).x = 0;
+    return (ar[2]).z + (ar[i-1]).y + (ar[0]).x;
+}
+EXPECT(6) { struct { char c; int ar[3]; } s; int i = 2; (s.ar)[i] = 4; (s.ar)[0] = 2; return (s.ar)[2] + (s.ar)[0]; }
+
+// Struct values.
+struct pt { int x; int y; };
+struct seg { struct pt a; struct pt b; };
+struct big { int v[6]; };
+struct pt pt_make(int x, int y) { struct pt p; p.x = x; p.y = y; return p; }
+int pt_dot(struct pt p, struct pt q) { return p.x * q.x + p.y * q.y; }
+struct seg seg_make(struct pt a, struct pt b) { struct seg s; s.a = a; s.b = b; return s; }
+int seg_len2(struct seg s) { int dx = (s.b).x - (s.a).x; int dy = (s.b).y - (s.a).y; return dx * dx + dy * dy; }
+struct big big_make(int x) { struct big b; int i; for (i = 0; i < 6; i++) (b.v)[i] = x + i; return b; }
+int big_sum(struct big b) { int s = 0; int i; for (i = 0; i < 6; i++) s += (b.v)[i]; return s; }
+int seg_mix(int a, int b, int c, int d, int e, struct seg s, int f) { return a + b + c + d + e + (s.b).y * f; }
+struct pt gpt_swap(struct pt p);
+struct big gbig_fill(int x);
+int gbig_sum(int k, struct big b, int m);
+EXPECT(11) { struct pt a = pt_make(1, 2); struct pt b = pt_make(3, 4); return pt_dot(a, b); }
+EXPECT(5) { struct pt a; struct pt b; a.x = 5; a.y = 6; b = a; a.x = 0; return b.x + a.x; }
+EXPECT(25) { struct seg s = seg_make(pt_make(1, 2), pt_make(4, 6)); return seg_len2(s); }
+EXPECT(45) { return big_sum(big_make(5)); }
+EXPECT(30) { int x = 3; return x + big_sum(big_make(2)); }
+EXPECT(5) { return ((big_make(3)).v)[2]; }
+EXPECT(55) { struct seg s = seg_make(pt_make(1, 2), pt_make(3, 4)); return seg_mix(1, 2, 3, 4, 5, s, 10); }
+EXPECT(57) { struct seg s = seg_make(pt_make(1, 2), pt_make(3, 4)); int x = 2; return x + seg_mix(1, 2, 3, 4, 5, s, 10); }
+EXPECT(21) { struct pt p = gpt_swap(pt_make(1, 2)); return p.x * 10 + p.y; }
+EXPECT(91) { return gbig_sum(2, gbig_fill(3), 1); }
+
+// Block copy and zeroing.
+struct msg { int v[64]; };
+struct log { char tag; int v[100]; };
+struct msg msg_fill(int x) { struct msg m; int i; for (i = 0; i < 64; i++) (m.v)[i] = x + i; return m; }
+int msg_sum(struct msg m) { int s = 0; int i; for (i = 0; i < 64; i++) s += (m.v)[i]; return s; }
+struct log log_fill(int x) { struct log l; int i; for (i = 0; i < 100; i++) (l.v)[i] = x; return l; }
+int log_sum(int k, struct log l, struct log m) { int s = 0; int i; for (i = 0; i < 100; i++) s += (l.v)[i] - (m.v)[i]; return s * k; }
+EXPECT(32) { struct msg a = msg_fill(0); struct msg b; b = a; (a.v)[63] = 0; return (b.v)[63] - (a.v)[31]; }
+EXPECT(208) { struct msg a = msg_fill(1); struct msg b = a; return msg_sum(b) / 10; }
+EXPECT(7) { struct log a = log_fill(7); struct log b; b = a; (a.v)[99] = 0; return (b.v)[99] + (a.v)[99]; }
+EXPECT(200) { return log_sum(2, log_fill(3), log_fill(2)); }
+EXPECT(0) { int s = 0; int i; for (i = 0; i < 7; i++) { char c[7] = {0}; s += c[i]; c[i] = 9; } return s; }
+EXPECT(0) { int s = 0; int i; for (i = 0; i < 9; i++) { int a[100] = {}; s += a[i * 11]; a[i * 11] = 5; } return s; }
+EXPECT(3) { struct seg s = {0}; int x = {0}; return (s.b).y + x + 3; }
+
+// Initializers.
+int gini_ar[5] = {1, 2, 3};
+int gini_2d[2][3] = {{1, 2, 3}, {4, 5}};
+char gini_str[] = "ab\tc";
+char *gini_ptr = "xyz";
+int *gini_elem = &gini_ar[2];
+int *gini_sum = gini_ar + 1;
+struct pt gini_pt = {3, 4};
+struct seg gini_seg = {{1, 2}, {3}};
+struct pt gini_pts[3] = {1, 2, 3, 4};
+int *gini_member = &gini_pt.y;
+const int gini_tab[] = {10, 20, 30, 40};
+short gini_short[3] = {7, 300};
+char gini_names[2][4] = {"ab", "cde"};
+char gini_hex[] = "\x41\x7a!";
+int gini_wrap = 100000 * 100000;
+int ini_local(int k) { int ar[4] = {1, k, 3}; struct pt p = {k, k + 1}; return ar[0] + ar[1] + ar[2] + ar[3] + p.y; }
+int ini_table(int i) { const int tab[] = {5, 6, 7, 8}; return tab[i]; }
+EXPECT(6) { return gini_ar[0] + gini_ar[1] + gini_ar[2] + gini_ar[3] + gini_ar[4]; }
+EXPECT(5) { return (gini_2d[1])[1] + (gini_2d[1])[2]; }
+EXPECT(6) { return gini_str[0] + gini_str[2] + gini_str[4] - 100; }
+EXPECT(121) { return gini_ptr[1]; }
+EXPECT(189) { return gini_hex[0] + gini_hex[1] + (gini_hex[2] == 33) + (gini_hex[3] == 0); }
+EXPECT(99) { char s[] = "\x62\x63"; return s[1]; }
+EXPECT(1410065408) { return gini_wrap; }
+EXPECT(5) { return *gini_elem + *gini_sum; }
+EXPECT(7) { return gini_pt.x + gini_pt.y; }
+EXPECT(6) { return ((gini_seg.a).y) + ((gini_seg.b).x) + ((gini_seg.b).y) + 1; }
+EXPECT(4) { return ((gini_pts[1]).y) + ((gini_pts[2]).x); }
+EXPECT(9) { *gini_member = 9; return gini_pt.y; }
+EXPECT(100) { return gini_tab[0] + gini_tab[1] + gini_tab[2] + gini_tab[3]; }
+EXPECT(51) { return gini_short[0] + gini_short[1] - 256 + gini_short[2]; }
+EXPECT(101) { return (gini_names[1])[2]; }
+EXPECT(9) { return ini_local(2); }
+EXPECT(22) { int s = 0; int i; for (i = 0; i < 4; i++) s += ini_table(i); return s - 4; }
+EXPECT(15) { int k = 3; struct pt q = {3, 4}; struct seg s = {q, {k}}; return ((s.a).x) + ((s.a).y) + ((s.b).x) + ((s.b).y) + 5; }
+EXPECT(99) { char s[8] = "abc"; return s[2] + s[3] + s[7]; }
+EXPECT(6) { int s = 0; int i; for (i = 0; i < 3; i++) { int ar[3] = {i, 1}; s += ar[0] + ar[2]; ar[2] = 5; } return s + 3; }
+
+// Data layout and alignment.
+int addr_mod(char *p, int n);
+struct line { int v; } __attribute__((aligned(64)));
+struct wrap { char c; struct line l; };
+char galn_c;
+int galn_ar[16];
+char galn_buf[20];
+struct line galn_lines[2];
+_Alignas(32) char galn_key[3];
+int galn_attr __attribute__((aligned(16))) = 5;
+const int galn_zero[4];
+int aln_local(int k) { char c[3]; _Alignas(16) char buf[4]; buf[0] = k; c[0] = k; return addr_mod(buf, 16) + buf[0] + c[0]; }
+EXPECT(64) { return sizeof(struct line); }
+EXPECT(128) { return sizeof(struct wrap); }
+EXPECT(0) { return addr_mod(galn_ar, 64) + addr_mod(galn_buf, 16) + addr_mod(galn_lines, 64); }
+EXPECT(0) { return addr_mod(&(galn_lines[1]), 64) + addr_mod(galn_key, 32) + addr_mod(&galn_attr, 16); }
+EXPECT(5) { galn_c = 1; return galn_attr + galn_zero[3]; }
+EXPECT(6) { return aln_local(3); }
+
+// Switch statements.
+int sw_dense(int x) { switch (x) { case 0: return 10; case 1: return 11; case 2: return 12; case 3: return 13; case 5: return 15; default: return 99; } }
+int sw_sparse(int x) { int r = 0; switch (x) { case 1: r = 1; break; case 100: r = 2; break; case 1000: r = 3; break; case -7: r = 4; break; case 50000: r = 5; break; case 7: r = 6; } return r; }
+int sw_bits(int x) { switch (x) { case 1: case 3: case 5: case 9: case 40: return 1; case 2: case 4: case 6: case 8: case 62: return 2; } return 0; }
+int sw_fall(int x) { int s = 0; switch (x) { case 1: s += 1; case 2: s += 2; break; default: s += 100; case 3: s += 3; } return s; }
+int sw_nested(int x, int y) { switch (x) { case 0: switch (y) { case 0: return 1; default: return 2; } case 1: { int z = y * 2; return z + 10; } } return 0; }
+int sw_loop(int n) { int s = 0; int i; for (i = 0; i < n; i++) { switch (i % 4) { case 0: s += 1; break; case 1: s += 10; break; default: s += 100; } } return s; }
+int sw_const(int k) { int x = 1; switch (3) { case 1: x = 2; break; case 3: x = x + k; case 4: x = x * 2; } return x; }
+int sw_merge(int k) { int x = 1; switch (k) { case 1: x = 2; case 2: return x; } return x + 10; }
+int sw_char(char c) { switch (c) { case 97: return 1; case 98: return 2; case 200: return 3; } return 0; }
+int brk_for(int n) { int i; int s = 0; for (i = 0; i < n; i++) { if (i == 5) break; s += i; } return s + i * 100; }
+int brk_while(int *a) { int i = 0; while (1) { if (a[i] == 0) break; i++; } return i; }
+EXPECT(61) { return sw_dense(0) + sw_dense(3) + sw_dense(5) + sw_dense(4) - 76; }
+EXPECT(99) { return sw_dense(6); }
+EXPECT(21) { return sw_sparse(1) + sw_sparse(100) + sw_sparse(1000) + sw_sparse(-7) + sw_sparse(50000) + sw_sparse(7) + sw_sparse(8); }
+EXPECT(9) { return sw_bits(1) + sw_bits(40) + sw_bits(62) + sw_bits(4) + sw_bits(7) + sw_bits(64) + sw_bits(0) + sw_bits(9) + sw_bits(8); }
+EXPECT(208) { return sw_fall(1) + sw_fall(2) + sw_fall(3) + sw_fall(9) + 97; }
+EXPECT(15) { return sw_nested(0, 0) + sw_nested(0, 5) + sw_nested(1, 1) + sw_nested(2, 0); }
+EXPECT(433) { return sw_loop(10); }
+EXPECT(12) { return sw_const(5); }
+EXPECT(14) { return sw_merge(1) + sw_merge(2) + sw_merge(3); }
+EXPECT(6) { return sw_char(97) + sw_char(98) + sw_char(200) + sw_char(99); }
+EXPECT(813) { return brk_for(3) + brk_for(10); }
+EXPECT(3) { int a[5] = {4, 5, 6, 0, 7}; return brk_while(a); }
+
+// Goto statements and label addresses.
+int gt_run(char *code, int n) {
+    char *const ops[4] = { &&op_halt, &&op_add, &&op_dbl, &&op_dec };
+    int acc = 0;
+    int pc = 0;
+    goto *ops[code[pc]];
+op_add: acc += n; pc++; goto *ops[code[pc]];
+op_dbl: acc *= 2; pc++; goto *ops[code[pc]];
+op_dec: acc -= 1; pc++; goto *ops[code[pc]];
+op_halt: return acc;
+}
+int gt_loop(int n) { int s = 0; int i = 0; top: if (i >= n) goto done; s += i; i++; goto top; done: return s; }
+int gt_nested(int n) { int i; int j; for (i = 0; i < n; i++) for (j = 0; j < n; j++) if (i * j == 12) goto found; return -1; found: return i * 10 + j; }
+int gt_store(int k) { char *ops[2]; int r = 0; ops[0] = &&a; ops[1] = &&b; goto *ops[k]; a: r += 1; b: r += 2; return r; }
+int gt_if(int k) { int r = 0; if (k) done: r += 5; else goto done; return r; }
+int gt_inner(int x) { if (x > 0) goto pos; return 0; pos: return 1; }
+int gt_g;
+int gt_setg(int x) { if (x) goto set; return 0; set: gt_g = x; }
+int gt_slots(int n) { int s = 0; int i = 0; top: { int a = i * 1000 + 5; s += a; if (i) goto after; } int b = 7; after: s += b; i++; if (i < n) goto top; return s; }
+EXPECT(28) { return gt_run("\1\2\1\3\2", 5); }
+EXPECT(45) { return gt_loop(10); }
+EXPECT(34) { return gt_nested(5); }
+EXPECT(-1) { return gt_nested(3); }
+EXPECT(5) { return gt_store(0) + gt_store(1); }
+EXPECT(15) { return gt_if(0) + gt_if(1) * 2; }
+EXPECT(2) { return gt_inner(3) + gt_inner(-3) + gt_inner(9); }
+EXPECT(3) { int i = 0; again: i++; if (i < 3) goto again; return i; }
+EXPECT(7) { gt_setg(0); gt_setg(7); return gt_g + gt_setg(0); }
+EXPECT(3036) { return gt_slots(3); }
+
 // Type size.
 EXPECT(1) { return sizeof(char); }
 EXPECT(4) { return sizeof(int); }
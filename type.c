@@ -39,8 +39,9 @@ size_t get_typesize(const Type *type) {
             totalsize = last + (size_t)get_typesize(last_member);
         }
         totalsize = get_nonaligned_size(type);
-        // Align to 8 bytes (assuming totalsize >= 0);
-        totalsize += (-(totalsize & 7)) & 7;
+        // Round up to the alignment, so that elements of an array are aligned.
+        size_t align = get_typealign(type);
+        totalsize += (-(totalsize & (align-1))) & (align-1);
         assert(totalsize % 8 == 0);
         return totalsize;
     }
@@ -51,10 +52,40 @@ size_t get_typesize(const Type *type) {
     }
 }
 
+// Alignment of a variable of a type. Structs are aligned as their sizes are
+// rounded, to 8 bytes. An alignment given explicitly may raise it.
+size_t get_typealign(const Type *type) {
+    size_t align;
+    switch (type->ty) {
+    case ARRAY:
+        align = get_typealign(type->ptr_of);
+        break;
+    case STRUCT:
+        align = 8;
+        break;
+    default:
+        align = get_typesize(type);
+        break;
+    }
+    return type->align > align ? type->align : align;
+}
+
 bool is_basic_type(const Type *type) {
     return type->ty == CHAR || type->ty == SHORT || type->ty == INT;
 }
 
+// A pointer, or an array, which is used as a pointer to its first element.
+bool is_ptr_like(const Type *type) {
+    return type && (type->ty == PTR || type->ty == ARRAY);
+}
+
+// An object of a const type, or an array of them, cannot be modified.
+bool is_readonly(const Type *type) {
+    while (!type->is_const && type->ty == ARRAY)
+        type = type->ptr_of;
+    return type->is_const;
+}
+
 Type *deduce_type(int operator, Node *lhs, Node *rhs) {
     // If one of the side has an unknown type, return the type of the other side.
     // This is necessary primarily because we don't check function signatures at
@@ -98,12 +129,8 @@ void add_member(Type *struct_type, const char *member_name, Type *member_type) {
     // Store the offset.
     // Nonaligned offset for the new member.
     size_t offset = get_nonaligned_size(struct_type);
-    // Alignment. If the member is an array, align to the size of the array element.
-    size_t align_to;
-    if (member_type->ty != ARRAY)
-        align_to = get_typesize(member_type);
-    else
-        align_to = get_typesize(member_type->ptr_of);
+    // Alignment. If the member is an array, align as the array element.
+    size_t align_to = get_typealign(member_type);
     // Align to the next boundary of align_to.
     offset += (-(offset & (align_to-1)) & (align_to-1));
     map_put(member_offsets, member_name, (void *)offset);
@@ -63,6 +63,41 @@ static void type_is_basic_type_test() {
     fprintf(stderr, "Type basic type test OK\n");
 }
 
+static void type_is_readonly_test() {
+    Type ty_int = (Type) { .ty = INT };
+    Type ty_cint = (Type) { .ty = INT, .is_const = true };
+    Type ty_pcint = (Type) { .ty = PTR, .ptr_of = &ty_cint };
+    Type ty_cpint = (Type) { .ty = PTR, .ptr_of = &ty_int, .is_const = true };
+    Type ty_arcint = (Type) { .ty = ARRAY, .ptr_of = &ty_cint, .array_len = 3 };
+    Type ty_ararcint = (Type) { .ty = ARRAY, .ptr_of = &ty_arcint, .array_len = 2 };
+    Type ty_arpcint = (Type) { .ty = ARRAY, .ptr_of = &ty_pcint, .array_len = 3 };
+
+    expect(__LINE__, 0, is_readonly(&ty_int));
+    expect(__LINE__, 1, is_readonly(&ty_cint));
+    expect(__LINE__, 0, is_readonly(&ty_pcint));
+    expect(__LINE__, 1, is_readonly(&ty_cpint));
+    expect(__LINE__, 1, is_readonly(&ty_arcint));
+    expect(__LINE__, 1, is_readonly(&ty_ararcint));
+    expect(__LINE__, 0, is_readonly(&ty_arpcint));
+
+    fprintf(stderr, "Type readonly test OK\n");
+}
+
+static void type_is_ptr_like_test() {
+    Type ty_int = (Type) { .ty = INT };
+    Type ty_pint = (Type) { .ty = PTR, .ptr_of = &ty_int };
+    Type ty_arint = (Type) { .ty = ARRAY, .ptr_of = &ty_int, .array_len = 3 };
+    Type ty_struct = (Type) { .ty = STRUCT };
+
+    expect(__LINE__, 0, is_ptr_like(&ty_int));
+    expect(__LINE__, 1, is_ptr_like(&ty_pint));
+    expect(__LINE__, 1, is_ptr_like(&ty_arint));
+    expect(__LINE__, 0, is_ptr_like(&ty_struct));
+    expect(__LINE__, 0, is_ptr_like(NULL));
+
+    fprintf(stderr, "Type pointer-like test OK\n");
+}
+
 static void type_getsize_test() {
     // Basic types.
     Type ty_char = (Type) { .ty = CHAR, .ptr_of = NULL, .array_len = 0 };
@@ -108,6 +143,12 @@ static void type_getsize_test() {
     Type ty_arpint = (Type) { .ty = ARRAY, .ptr_of = &ty_pint, .array_len = 3 };
     expect(__LINE__, 24, get_typesize(&ty_arpint));
 
+    // Alignment.
+    expect(__LINE__, 1, get_typealign(&ty_char));
+    expect(__LINE__, 2, get_typealign(&ty_arshort));
+    expect(__LINE__, 4, get_typealign(&ty_int));
+    expect(__LINE__, 8, get_typealign(&ty_arpint));
+
     // Structures.
     Map *member_types = new_map();
     Map *member_offsets = new_map();
@@ -137,6 +178,7 @@ static void type_getsize_test() {
 
     add_member(&ty_struct, "ari3_10", &ty_arint);
     expect(__LINE__, 48, get_typesize(&ty_struct));
+    expect(__LINE__, 8, get_typealign(&ty_struct));
 
     // Offset alignment of struct members.
     expect(__LINE__, 0, get_member_offset(&ty_struct, "c1"));
@@ -150,6 +192,28 @@ static void type_getsize_test() {
     expect(__LINE__, 30, get_member_offset(&ty_struct, "arc3_9"));
     expect(__LINE__, 36, get_member_offset(&ty_struct, "ari3_10"));
 
+    // An explicit alignment rounds the size of a struct up to it, and a
+    // member of the struct is placed at the alignment.
+    Type ty_aligned = (Type) {
+        .ty = STRUCT,
+        .align = 64,
+        .member_types = new_map(),
+        .member_offsets = new_map()
+    };
+    add_member(&ty_aligned, "i1", &ty_int);
+    expect(__LINE__, 64, get_typealign(&ty_aligned));
+    expect(__LINE__, 64, get_typesize(&ty_aligned));
+    add_member(&ty_struct, "s11", &ty_aligned);
+    expect(__LINE__, 64, get_member_offset(&ty_struct, "s11"));
+    expect(__LINE__, 128, get_typesize(&ty_struct));
+
+    // A smaller alignment than the natural one is ignored.
+    Type ty_int2 = (Type) { .ty = INT, .align = 2 };
+    expect(__LINE__, 4, get_typealign(&ty_int2));
+    Type ty_arint16 = (Type) { .ty = ARRAY, .ptr_of = &ty_int, .array_len = 3, .align = 16 };
+    expect(__LINE__, 16, get_typealign(&ty_arint16));
+    expect(__LINE__, 12, get_typesize(&ty_arint16));
+
     fprintf(stderr, "Type size test OK\n");
 }
 
@@ -266,6 +330,8 @@ static void type_deduction_test() {
 
 void runtest_type() {
     type_is_basic_type_test();
+    type_is_readonly_test();
+    type_is_ptr_like_test();
     type_getsize_test();
     type_deduction_test();
 }
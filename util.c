@@ -27,19 +27,47 @@ Map *new_map() {
     Map *map = malloc(sizeof(Map));
     map->keys = new_vector();
     map->vals = new_vector();
+    map->nslots = 16;
+    map->index = calloc(map->nslots, sizeof(int));
     return map;
 }
 
+// FNV-1a.
+static unsigned hash(const char *key) {
+    unsigned h = 2166136261u;
+    for (; *key; key++)
+        h = (h ^ (unsigned char)*key) * 16777619u;
+    return h;
+}
+
+// Find the slot of a key, or the empty slot to put it in.
+static int find_slot(const Map *map, const char *key) {
+    int mask = map->nslots - 1;
+    int slot = (int)(hash(key) & (unsigned)mask);
+    while (map->index[slot] && strcmp(map->keys->data[map->index[slot] - 1], key) != 0)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
 void map_put(Map *map, const char *key, const void *val) {
     vec_push(map->keys, (void *)key);
     vec_push(map->vals, val);
+
+    // Keep the load factor at most a half.
+    if (map->keys->len * 2 > map->nslots) {
+        free(map->index);
+        map->nslots *= 2;
+        map->index = calloc(map->nslots, sizeof(int));
+        for (int i = 0; i < map->keys->len; i++)
+            map->index[find_slot(map, map->keys->data[i])] = i + 1;
+        return;
+    }
+    map->index[find_slot(map, key)] = map->keys->len;
 }
 
 const void *map_get(const Map *map, const char *key) {
-    for (int i = map->keys->len - 1; i >= 0; i--)
-        if (strcmp(map->keys->data[i], key) == 0)
-            return map->vals->data[i];
-    return NULL;
+    int i = map->index[find_slot(map, key)];
+    return i ? map->vals->data[i - 1] : NULL;
 }
 
 int max(int x0, int x1) {
@@ -50,6 +50,18 @@ void map_test() {
     map_put(map, "foo", (void *)4);
     expect(__LINE__, 4, (int)map_get(map, "foo"));
 
+    // Growing the index keeps the latest entries.
+    char keys[100][8];
+    for (int i = 0; i < 100; i++) {
+        sprintf(keys[i], "k%d", i % 50);
+        map_put(map, keys[i], (void *)(i + 1));
+    }
+    expect(__LINE__, 103, map->keys->len);
+    expect(__LINE__, 51, (int)map_get(map, "k0"));
+    expect(__LINE__, 100, (int)map_get(map, "k49"));
+    expect(__LINE__, 4, (int)map_get(map, "foo"));
+    expect(__LINE__, (int)NULL, (int)map_get(map, "k50"));
+
     fprintf(stderr, "Map test OK\n");
 }
 